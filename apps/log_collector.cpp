@@ -0,0 +1,179 @@
+/* log_collector.cpp
+ *
+ * Collects the shared-memory log rings written by the "shm_ring" sink of LogConfig
+ * (see ShmLogRing.h) from every process on the host, merges them by timestamp and writes
+ * them in large batches to <output>.<YYYYMMDD_HHMMSS>.<seq>.log[.gz] segments.
+ *
+ * Usage: log_collector <config.yaml>
+ *   shm_ring_dir    : /dev/shm       # same as in the config_log yaml
+ *   shm_ring_name   : test           # shm_ring_name (or default_log_prefix) of the loggers
+ *   output          : log/collected  # segment path prefix
+ *   compression     : gzip           # or none
+ *   max_file_size   : 1073741824     # uncompressed bytes per segment
+ *   batch_size      : 1048576        # bytes gathered before each write
+ *   merge_delay_ms  : 100            # how long a message waits for earlier ones of other processes
+ *   poll_interval_ms: 10             # sleep when the rings are empty
+ *
+ * Runs until SIGINT/SIGTERM, then collects what is left and closes the segment.
+*/
+
+#include <signal.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <fmt/format.h>
+#include <yaml-cpp/yaml.h>
+#include "LogFileSinks.h"
+#include "ShmLogRing.h"
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+// Output segments, written in whole batches; gzip streams are flushed only when idle
+class SegmentWriter {
+public:
+    SegmentWriter(std::string base, wcc::LogCompression compression, size_t max_size)
+        : base_(std::move(base)), compression_(compression), max_size_(max_size) {
+        if (compression_ == wcc::LogCompression::zstd)
+            throw std::runtime_error("log_collector,UnsupportedCompression,zstd");
+        if (auto dir = std::filesystem::path(base_).parent_path(); !dir.empty())
+            std::filesystem::create_directories(dir);
+        open();
+    }
+
+    SegmentWriter(SegmentWriter const&) = delete;
+    SegmentWriter& operator=(SegmentWriter const&) = delete;
+
+    ~SegmentWriter() { close(); }
+
+    void write(std::string_view data) {
+        if (size_ > 0 && size_ + data.size() > max_size_) {
+            close();
+            open();
+        }
+        bool ok;
+#ifdef WCC_LOG_GZIP
+        if (gz_) ok = gzwrite(gz_, data.data(), static_cast<unsigned>(data.size())) == static_cast<int>(data.size());
+        else
+#endif
+        ok = std::fwrite(data.data(), 1, data.size(), file_) == data.size();
+        if (!ok) fmt::print(stderr, "log_collector,WriteFailed,file={}\n", name_);
+        size_ += data.size();
+    }
+
+    void flush() {
+#ifdef WCC_LOG_GZIP
+        if (gz_) gzflush(gz_, Z_SYNC_FLUSH);
+#endif
+        if (file_) std::fflush(file_);
+    }
+
+private:
+    void open() {
+        auto t = std::time(nullptr);
+        char stamp[16];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&t));
+        name_ = fmt::format("{}.{}.{}.log{}", base_, stamp, seq_++, wcc::log_compression_ext(compression_));
+        size_ = 0;
+#ifdef WCC_LOG_GZIP
+        if (compression_ == wcc::LogCompression::gzip) {
+            gz_ = gzopen(name_.c_str(), "wb6");
+            if (gz_ == nullptr) throw std::runtime_error(fmt::format("log_collector,OpenFailed,{}", name_));
+            gzbuffer(gz_, 1 << 20);
+            return;
+        }
+#endif
+        file_ = std::fopen(name_.c_str(), "wb");
+        if (file_ == nullptr) throw std::runtime_error(fmt::format("log_collector,OpenFailed,{}", name_));
+    }
+
+    void close() {
+#ifdef WCC_LOG_GZIP
+        if (gz_) gzclose(gz_);
+        gz_ = nullptr;
+#endif
+        if (file_) std::fclose(file_);
+        file_ = nullptr;
+    }
+
+    std::string base_;
+    wcc::LogCompression compression_;
+    size_t max_size_;
+    std::string name_;
+    size_t seq_ = 0;
+    size_t size_ = 0;
+    std::FILE* file_ = nullptr;
+#ifdef WCC_LOG_GZIP
+    gzFile gz_ = nullptr;
+#endif
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fmt::print(stderr, "usage: {} <config.yaml>\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        YAML::Node cfg = YAML::LoadFile(argv[1]);
+        auto get = [&cfg](char const* key, auto fallback) {
+            return cfg[key] ? cfg[key].as<decltype(fallback)>() : fallback;
+        };
+        std::string dir = get("shm_ring_dir", std::string("/dev/shm"));
+        std::string name = cfg["shm_ring_name"].as<std::string>();
+        std::string output = cfg["output"].as<std::string>();
+        auto compression = wcc::log_compression_from_str(get("compression", std::string("none")));
+        size_t max_file_size = get("max_file_size", size_t(1) << 30);
+        size_t batch_size = get("batch_size", size_t(1) << 20);
+        auto merge_delay = std::chrono::milliseconds(get("merge_delay_ms", 100));
+        auto poll_interval = std::chrono::milliseconds(get("poll_interval_ms", 10));
+
+        signal(SIGINT, [](int) { g_stop.store(true); });
+        signal(SIGTERM, [](int) { g_stop.store(true); });
+
+        wcc::ShmLogCollector collector(dir, name, merge_delay);
+        SegmentWriter writer(output, compression, max_file_size);
+        std::string batch;
+        batch.reserve(batch_size + 4096);
+        auto last_scan = std::chrono::steady_clock::time_point{};
+        auto last_flush = std::chrono::steady_clock::now();
+
+        while (!g_stop.load()) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_scan >= std::chrono::seconds(1)) {
+                collector.scan();
+                last_scan = now;
+            }
+            size_t n = collector.collect(batch, batch_size);
+            if (batch.size() >= batch_size || (n == 0 && !batch.empty())) {
+                writer.write(batch);
+                batch.clear();
+            }
+            if (n == 0) {
+                if (now - last_flush >= std::chrono::seconds(1)) {  // readable output while idle
+                    writer.flush();
+                    last_flush = now;
+                }
+                std::this_thread::sleep_for(poll_interval);
+            }
+        }
+
+        collector.scan();
+        while (collector.collect(batch, batch_size, true) > 0 || !batch.empty()) {
+            writer.write(batch);
+            batch.clear();
+        }
+    } catch (std::exception const& e) {
+        fmt::print(stderr, "log_collector,Failed,{}\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -1,79 +1,293 @@
 #pragma once
 
-#include "LogConfig.h"  // for wcc::log_debug
-#include <vector>
+#include "LogConfig.h"  // for wcc::log_debug, wcc::log_info
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
-#if defined(TEST)
-#  include <fmt/format.h>
-#  define MY_ASSERT(cond, msg) if (!(cond)) throw std::runtime_error((msg));
-#else
-#  define MY_ASSERT(cond, msg) assert(cond);
-#endif
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace wcc {
 
-struct SpinLock {
-    std::atomic_bool& locked;
-    SpinLock(std::atomic_bool& locked) : locked(locked) {
-        for (bool expected = false; !locked.compare_exchange_strong(expected, true); expected = false);
+// Where and how ChunkStorage maps its memory.
+struct ChunkStorageOptions {
+    uint32_t n_chunks = 1024;   // chunks mapped at construction, more are mapped when running out
+    int  numa_node    = -1;     // bind chunk memory to this NUMA node (mbind), -1 for the default policy
+    bool huge_pages   = false;  // try MAP_HUGETLB, fall back to transparent huge pages (madvise)
+    bool prefault     = false;  // touch the chunks mapped at construction so no page fault on the hot path
+    int  prefault_cpu = -1;     // set up and touch them on a thread pinned to this CPU, so first-touch places pages on its node
+    std::string name = {};      // shown in stats
+    bool log_stats    = false;  // log stats() at info level when the storage is destroyed
+};
+
+// Snapshot of ChunkStorage counters, to size n_chunks from production and to alert when
+// the hot path starts mapping memory.
+struct ChunkStorageStats {
+    constexpr static size_t k_latency_buckets = 32;
+
+    std::string name;
+    size_t   num_chunks_allocated = 0;  // chunks mapped
+    size_t   num_chunks_in_use    = 0;  // outstanding
+    size_t   water_mark           = 0;  // peak of chunks in use
+    uint64_t pool_hits            = 0;  // new_chunk served by the free list
+    uint64_t fallback_allocations = 0;  // new_chunk that had to map a new region
+    std::array<uint64_t, k_latency_buckets> new_chunk_latency = {};  // bucket i counts latencies in [2^i, 2^(i+1)) ns
+
+    std::string to_string() const {
+        std::string s = fmt::format("ChunkStorage[{}],allocated={},in_use={},water_mark={},pool_hits={},fallback_allocations={},latency_ns=",
+                                    name, num_chunks_allocated, num_chunks_in_use, water_mark, pool_hits, fallback_allocations);
+        for (size_t i = 0; i < k_latency_buckets; ++i) {
+            if (new_chunk_latency[i]) s += fmt::format("<{}:{};", uint64_t(2) << i, new_chunk_latency[i]);
+        }
+        return s;
     }
-    ~SpinLock() { locked = false; }
 };
 
-// ChunkStorage is not intended for outside
+// ChunkStorage is not intended for outside directly, but shared by AppendOnlyVec
+// instances given the same storage (see AppendOnlyVec::storage_type).
+//
+// A lock-free pool of chunks, new_chunk and return_chunk may be called from any
+// thread concurrently.
+//
+// Chunks live in nodes of mmap'ed regions which are never moved nor unmapped before
+// the storage is destroyed, so a chunk handed out stays valid wherever its owner is.
+// Free nodes form a Treiber stack. Its head packs the node pointer (user space addresses
+// fit in 48 bits on x86-64 and aarch64) with a 16 bits version tag bumped on every update,
+// so a pop racing with pops and pushes of the same node fails its CAS instead of linking
+// a node in use back into the list (ABA).
+// When the stack is empty a new region, as large as all nodes so far, is mapped, which is
+// the only path taking a lock. It gets the same NUMA and huge page setting but is not prefaulted.
 template <typename Chunk>
 class ChunkStorage
 {
+    struct Node {
+        Chunk chunk;  // first member, so a chunk pointer is also its node pointer
+        std::atomic<Node*> next = nullptr;
+    };
+
 public:
     using size_type  = Chunk::size_type;
 
-    ChunkStorage(uint32_t N) : new_curr_(0), return_curr_(0), chunks_(N) {
-        for (auto it = chunks_.begin(); it != chunks_.end(); ++it) {
-            it->reserve(Chunk::chunk_size);
+    ChunkStorage(uint32_t N) : ChunkStorage(ChunkStorageOptions{.n_chunks = N}) {}
+
+    ChunkStorage(ChunkStorageOptions const& options) : options_(options) {
+        static_assert(sizeof(void*) == 8, "ChunkStorage packs a tag in high 16 bits of pointers");
+        static_assert(std::is_standard_layout_v<Node>, "Node must be standard layout to cast from its chunk");
+        static_assert(std::is_trivially_destructible_v<Node>, "Nodes are unmapped without destruction");
+        if (options_.n_chunks) {
+            Node* nodes = map_nodes(options_.n_chunks);
+            populate(regions_.back(), nodes, options_.n_chunks);
         }
     }
 
-    ~ChunkStorage() {}
+    ~ChunkStorage() {
+        if (options_.log_stats) {
+            try {
+                wcc::log_info("{}", stats().to_string());
+            } catch (...) {}  // no logger, e.g. a static storage destroyed after logging at exit
+        }
+        for (auto const& r : regions_) munmap(r.addr, r.len);
+    }
 
-    size_t num_chunks_allocated() const { return chunks_.size(); }
-    size_t water_mark() const { return new_curr_; }
+    ChunkStorage(ChunkStorage const&) = delete;
+    ChunkStorage& operator=(ChunkStorage const&) = delete;
+
+    ChunkStorageOptions const& options() const { return options_; }
+
+    size_t num_chunks_allocated() const { return num_allocated_.load(std::memory_order_relaxed); }
+    size_t num_chunks_in_use() const { return num_in_use_.load(std::memory_order_relaxed); }
+    size_t water_mark() const { return water_mark_.load(std::memory_order_relaxed); }  // peak of chunks in use
+
+    ChunkStorageStats stats() const {
+        ChunkStorageStats st;
+        st.name                 = options_.name;
+        st.num_chunks_allocated = num_chunks_allocated();
+        st.num_chunks_in_use    = num_chunks_in_use();
+        st.water_mark           = water_mark();
+        st.pool_hits            = pool_hits_.load(std::memory_order_relaxed);
+        st.fallback_allocations = fallback_allocations_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < st.new_chunk_latency.size(); ++i) {
+            st.new_chunk_latency[i] = latency_[i].load(std::memory_order_relaxed);
+        }
+        return st;
+    }
 
-    Chunk& new_chunk() {
-        SpinLock lock(is_newing_);
+    Chunk* new_chunk() {
+        auto t0 = std::chrono::steady_clock::now();
+        Node* node = pop();
+        if (node) [[likely]] {
+            pool_hits_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            node = allocate_node();
+        }
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        latency_[std::min<size_t>(std::bit_width(ns | 1) - 1, latency_.size() - 1)].fetch_add(1, std::memory_order_relaxed);
+        size_t in_use = num_in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+        for (size_t peak = water_mark_.load(std::memory_order_relaxed);
+             in_use > peak && !water_mark_.compare_exchange_weak(peak, in_use, std::memory_order_relaxed); );
+        return &node->chunk;
+    }
 
-        MY_ASSERT(new_curr_ <= chunks_.size(), (fmt::format("new_curr:{} <= N{}", new_curr_, chunks_.size())))
-        if (new_curr_ == chunks_.size()) new_curr_ = 0;
+    // elements in the chunk must have been destroyed by its owner
+    void return_chunk(Chunk* chunk) {
+        num_in_use_.fetch_sub(1, std::memory_order_relaxed);
+        push(reinterpret_cast<Node*>(chunk));
+    }
 
-        // Note the fact that every unused chunk must be space reserved!
-        // When a chunk at position new_curr_ is used, its capacity must be zero
-        // since it simply is pure empty (not even reserve any space)
-        // (space swapped by the user using it).
-        if (chunks_[new_curr_].capacity() == 0) [[unlikely]] { // being used
-            //throw std::runtime_error("No free chunks left in storage");
-            // When no chunks, acquire by new alloc.
-            // TODO: recheck logic if using return_chunk!
-            chunks_.emplace_back();
-            new_curr_ = chunks_.size() - 1;
-            chunks_[new_curr_].reserve(Chunk::chunk_size);
-            wcc::log_debug("ChunkStorage::new_chunk: chunk_size:{}, current num of chunks:{}", Chunk::chunk_size, new_curr_);
+private:
+    struct Region {
+        void*  addr;
+        size_t len;
+    };
+
+    constexpr static unsigned  k_tag_shift = 48;
+    constexpr static uintptr_t k_ptr_mask  = (uintptr_t(1) << k_tag_shift) - 1;
+    constexpr static size_t    k_huge_page_size = size_t(2) << 20;
+
+    static Node* node_of(uintptr_t head) { return reinterpret_cast<Node*>(head & k_ptr_mask); }
+    static uintptr_t next_head(uintptr_t head, Node* node) {
+        uintptr_t tag = ((head >> k_tag_shift) + 1) & 0xFFFF;
+        return reinterpret_cast<uintptr_t>(node) | (tag << k_tag_shift);
+    }
+
+    void push(Node* node) {
+        uintptr_t head = head_.load(std::memory_order_relaxed);
+        do {
+            node->next.store(node_of(head), std::memory_order_relaxed);
+        } while (!head_.compare_exchange_weak(head, next_head(head, node), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    Node* pop() {
+        uintptr_t head = head_.load(std::memory_order_acquire);
+        while (Node* node = node_of(head)) {
+            // node may be popped by others meanwhile, but it is never freed, so reading its next is safe
+            // and the tag makes the CAS fail then
+            Node* next = node->next.load(std::memory_order_relaxed);
+            if (head_.compare_exchange_weak(head, next_head(head, next), std::memory_order_acquire, std::memory_order_acquire)) {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    Node* allocate_node() {
+        std::lock_guard<std::mutex> lock(allocate_mutex_);
+        if (Node* node = pop()) {  // another thread has mapped a region meanwhile
+            pool_hits_.fetch_add(1, std::memory_order_relaxed);
+            return node;
         }
-        return chunks_[new_curr_++]; // for moving
+        fallback_allocations_.fetch_add(1, std::memory_order_relaxed);
+        size_t n = std::max<size_t>(num_allocated_.load(std::memory_order_relaxed), 1);
+        Node* nodes = map_nodes(n);
+        for (size_t i = 0; i < n; ++i) new (&nodes[i]) Node;
+        for (size_t i = 1; i < n; ++i) push(&nodes[i]);
+        wcc::log_debug("ChunkStorage::new_chunk: chunk_size:{}, current num of chunks:{}", Chunk::chunk_size, num_chunks_allocated());
+        return &nodes[0];
     }
 
-    void return_chunk(Chunk& chunk) {
-        if (return_curr_ == chunks_.size()) return_curr_ = 0;
-        MY_ASSERT(chunks_[return_curr_].capacity() == 0,
-          (fmt::format("chunks_[return_curr_({})].capaticy()=={}, expected 0", return_curr_, chunks_[return_curr_].capacity())));  // current place is no used by any chunk
-        chunk.clear();  // leaves the capacity() of the chunk unchanged
-        chunks_[return_curr_++] = std::move(chunk);
+    // maps memory for n nodes and binds it; the caller constructs the nodes, which writes
+    // their free list links and so first-touches the pages holding them
+    Node* map_nodes(size_t n) {
+        size_t page = options_.huge_pages ? k_huge_page_size : size_t(sysconf(_SC_PAGESIZE));
+        size_t len  = (n * sizeof(Node) + page - 1) / page * page;
+        void*  addr = MAP_FAILED;
+        if (options_.huge_pages) {
+            addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (addr == MAP_FAILED) {
+                wcc::log_debug("ChunkStorage: MAP_HUGETLB failed ({}), use transparent huge pages", strerror(errno));
+            }
+        }
+        if (addr == MAP_FAILED) {
+            addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED) {
+                throw std::runtime_error(std::string("ChunkStorage: failed to map chunks: ") + strerror(errno));
+            }
+            if (options_.huge_pages) madvise(addr, len, MADV_HUGEPAGE);
+        }
+        regions_.push_back(Region{addr, len});
+        if (options_.numa_node >= 0) bind(addr, len, options_.numa_node);
+
+        num_allocated_.fetch_add(n, std::memory_order_relaxed);
+        return static_cast<Node*>(addr);
     }
 
-private:
-    std::atomic_bool is_newing_ = false;
-    size_type new_curr_;
-    size_type return_curr_;
-    std::vector<Chunk> chunks_;
+    // mbind via syscall, so no need to link libnuma
+    static void bind(void* addr, size_t len, int node) {
+        constexpr int k_mpol_bind = 2;  // MPOL_BIND in <numaif.h>
+        constexpr size_t k_bits = 8 * sizeof(unsigned long);
+        unsigned long mask[1024 / k_bits] = {};
+        if (node >= 1024) throw std::runtime_error("ChunkStorage: numa node out of range: " + std::to_string(node));
+        mask[node / k_bits] = 1UL << (node % k_bits);
+        if (syscall(SYS_mbind, addr, len, k_mpol_bind, mask, 1024 + 1, 0) != 0) {
+            throw std::runtime_error("ChunkStorage: failed to bind chunks to numa node " + std::to_string(node)
+                                     + ": " + strerror(errno));
+        }
+    }
+
+    // Constructs the nodes of the region mapped at construction and pushes them to the free
+    // list, after touching every page if prefault is set. All of it runs on the prefault_cpu
+    // thread when one is given, so that no page is first-touched by the calling thread.
+    void populate(Region const& r, Node* nodes, size_t n) {
+        auto init = [&]() {
+            if (options_.prefault) {
+                size_t page = size_t(sysconf(_SC_PAGESIZE));
+                auto p = static_cast<volatile char*>(r.addr);
+                for (size_t off = 0; off < r.len; off += page) p[off] = 0;
+            }
+            for (size_t i = 0; i < n; ++i) new (&nodes[i]) Node;  // default init leaves chunk bytes as they are
+            for (size_t i = 0; i < n; ++i) push(&nodes[i]);
+        };
+        if (options_.prefault_cpu < 0) {
+            init();
+            return;
+        }
+        std::thread th([&]() {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(options_.prefault_cpu, &cpus);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+                wcc::log_debug("ChunkStorage: failed to pin prefault thread to cpu {}", options_.prefault_cpu);
+            }
+            init();
+        });
+        th.join();
+    }
+
+    ChunkStorageOptions options_;
+
+    std::atomic<uintptr_t> head_ = 0;  // tagged pointer to the top free node
+    std::atomic<size_t> num_allocated_ = 0;
+    std::atomic<size_t> num_in_use_ = 0;
+    std::atomic<size_t> water_mark_ = 0;
+    std::atomic<uint64_t> pool_hits_ = 0;
+    std::atomic<uint64_t> fallback_allocations_ = 0;
+    std::array<std::atomic<uint64_t>, ChunkStorageStats::k_latency_buckets> latency_ = {};
+
+    std::mutex allocate_mutex_;
+    std::vector<Region> regions_;  // mapped at construction, then by allocate_node under allocate_mutex_
 };
 
 
@@ -82,6 +296,28 @@ private:
  *
  * Memory block never be reallocated or moved, only added chunk by chunk,
  * where chunk is size-fixed (and specified) at compiler time.
+ *
+ * Single writer, multiple readers (SPMR):
+ * One thread appends (push_back/emplace_back/append...) while any number of other threads
+ * read elements at indices below size(), without locks. Each append publishes
+ * the new size with release order after the element is constructed, and readers
+ * load it with acquire order. Readers locate chunks by a directory of chunk data
+ * pointers that is never modified in place when grown: a larger copy is published
+ * and the old ones are kept until destruction, so a reader never sees a moved
+ * directory. reserve() sizes the directory up front.
+ * clear(), move construction and move assignment are writer-only operations that
+ * must not run concurrently with readers.
+ *
+ * Rolling window:
+ * The writer may retire the oldest whole chunks by retire_until(index), e.g. to keep the
+ * last hour of ticks in constant memory. Indices stay stable: size() keeps counting every
+ * element ever appended, and elements below oldest_index() are gone. The directory is a
+ * ring indexed by chunk index modulo its capacity, so it only grows with the number of
+ * chunks alive. Retired chunks go back to the storage only when no reader may still use
+ * them (epoch based reclamation): a reader of a vector that retires holds a read_guard()
+ * while accessing elements, and takes oldest_index() after the guard:
+ *   auto guard = vec.read_guard();
+ *   for (size_t i = std::max(next, vec.oldest_index()), n = vec.size(); i < n; ++i) use(vec[i]);
  */
 
 template <class Vec, bool IsConst>
@@ -133,53 +369,134 @@ private:
     vec_ref_type vec_;
 };
 
+// Chunk by chunk view over elements [first_chunk * ChunkSize, n) of an AppendOnlyVec,
+// yielding std::span<U> per chunk, all full but the last one. Inner loops over a span
+// are plain pointer loops, which compilers vectorize, unlike VecIterator which
+// goes through operator[] on every dereference.
+template <typename U, size_t ChunkSize>
+class ChunkRange {
+public:
+    using size_type = size_t;
+
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = std::span<U>;
+        using difference_type   = std::ptrdiff_t;
+
+        iterator() = default;
+        iterator(U* const* slots, size_type mask, size_type n, size_type c) : slots_(slots), mask_(mask), n_(n), c_(c) {}
+
+        std::span<U> operator*() const { return {slots_[c_ & mask_], std::min(ChunkSize, n_ - c_ * ChunkSize)}; }
+
+        iterator& operator++()    { ++c_; return *this; }
+        iterator  operator++(int) { iterator it = *this; ++c_; return it; }
+
+        friend bool operator==(iterator const& l, iterator const& r) { return l.c_ == r.c_; }
+    private:
+        U* const* slots_ = nullptr;
+        size_type mask_ = 0;
+        size_type n_ = 0;
+        size_type c_ = 0;  // chunk index
+    };
+
+    ChunkRange(U* const* slots, size_type mask, size_type first_chunk, size_type n)
+        : slots_(slots), mask_(mask), first_(first_chunk), n_(n) {}
+
+    iterator begin() const { return iterator(slots_, mask_, n_, first_); }
+    iterator end()   const { return iterator(slots_, mask_, n_, first_ + size()); }
+
+    size_type size() const { return (n_ + ChunkSize - 1) / ChunkSize - first_; }  // number of chunks
+    bool empty() const { return !size(); }
+    std::span<U> operator[](size_type k) const { return *iterator(slots_, mask_, n_, first_ + k); }
+
+    size_type first_index() const { return first_ * ChunkSize; }  // index of the first element
+    size_type end_index()   const { return n_; }
+
+private:
+    U* const* slots_;
+    size_type mask_;
+    size_type first_;  // chunk index of the first chunk
+    size_type n_;      // end index of elements
+};
+
 // ChunkSize is capacity of each chunk.
-// chunks_.size() is number of chunks.
+// Chunks are numbered from 0 in appending order, element i is in chunk i / ChunkSize.
 template <typename T, size_t ChunkSize>
 class AppendOnlyVec {
 public:
-    struct Chunk : std::vector<T> {
+    // Raw, cache line aligned memory for ChunkSize elements, which are constructed
+    // and destroyed by the owning AppendOnlyVec.
+    struct alignas(std::max<size_t>(64, alignof(T))) Chunk {
+        using size_type = size_t;
         constexpr static uint32_t chunk_size = ChunkSize;
 
-        Chunk() = default;  // { this->reserve(ChunkSize); }
-        // Move ctor and assignment will be default and use that of std::vector;
-        // anyway we make our intention explicit!
-        Chunk(Chunk&&) = default;
-        Chunk(Chunk const&) = delete;
-        Chunk& operator=(Chunk&&) = default;
-        Chunk& operator=(Chunk const&) = delete;
+        T* data() { return reinterpret_cast<T*>(bytes); }
+        static Chunk* of(T* data) { return reinterpret_cast<Chunk*>(data); }
+
+        std::byte bytes[sizeof(T) * ChunkSize];
     };
 
-    using value_type             = Chunk::value_type;
-    using size_type              = Chunk::size_type;
-    using difference_type        = Chunk::difference_type;
-    using reference              = Chunk::reference;
-    using const_reference        = Chunk::const_reference;
-    using pointer                = Chunk::pointer;
-    using const_pointer          = Chunk::const_pointer;
+    using value_type             = T;
+    using size_type              = size_t;
+    using difference_type        = std::ptrdiff_t;
+    using reference              = T&;
+    using const_reference        = T const&;
+    using pointer                = T*;
+    using const_pointer          = T const*;
     using iterator               = VecIterator<AppendOnlyVec, false>;
     using const_iterator         = VecIterator<AppendOnlyVec, true>;
     using reverse_iterator       = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
-    using allocator_type         = typename Chunk::allocator_type;
 
-    AppendOnlyVec() {
+    using storage_type           = ChunkStorage<Chunk>;
+
+    constexpr static size_t k_max_readers = 64;  // concurrent read_guard()s per vector
+
+    // Keeps chunks retired after it was taken from going back to the storage, see read_guard()
+    class ReadGuard {
+    public:
+        explicit ReadGuard(std::atomic<uint64_t>* slot) : slot_(slot) {}
+        ReadGuard(ReadGuard&& o) : slot_(std::exchange(o.slot_, nullptr)) {}
+        ReadGuard(ReadGuard const&) = delete;
+        ReadGuard& operator=(ReadGuard const&) = delete;
+        ~ReadGuard() { if (slot_) slot_->store(0, std::memory_order_release); }
+    private:
+        std::atomic<uint64_t>* slot_;
+    };
+
+    // Uses the default storage shared by all vectors of this type, set up by config()
+    AppendOnlyVec() : storage_(StoragePtr) {
         static_assert((ChunkSize & (ChunkSize-1)) == 0, "ChunkSize must be power of 2");
         if (!IsConfigured) [[unlikely]] {
             throw std::logic_error("Construct AppendOnlyVec before calling AppendOnlyVec::config()");
         }
     }
 
+    // Uses the given storage, e.g. a pool bound to the NUMA node of the writing thread,
+    // shared with other vectors of the same subsystem:
+    //   auto storage = std::make_shared<Vec::storage_type>(wcc::ChunkStorageOptions{.n_chunks = 4096, .numa_node = 1});
+    //   Vec vec(storage);
+    explicit AppendOnlyVec(std::shared_ptr<storage_type> storage) : storage_(std::move(storage)) {
+        if (!storage_) throw std::invalid_argument("AppendOnlyVec: null storage");
+    }
+
     static void config(size_t n_chunks) {
+        config(ChunkStorageOptions{.n_chunks = uint32_t(n_chunks)});
+    }
+
+    static void config(ChunkStorageOptions const& options) {
         if (!IsConfigured) {
-            NumChunks = n_chunks;
-            StoragePtr = std::make_unique<ChunkStorage<Chunk>>(NumChunks);
+            NumChunks = options.n_chunks;
+            StoragePtr = std::make_shared<storage_type>(options);
             IsConfigured = true;
         } else {
             throw std::logic_error("Calling AppendOnlyVec::config multiple times!");
         }
     }
 
+    std::shared_ptr<storage_type> const& storage() const { return storage_; }
+
     static size_t num_chunks_allocated() {
         if (IsConfigured) [[likely]] {
             return StoragePtr->num_chunks_allocated();
@@ -187,104 +504,326 @@ public:
         throw std::logic_error("Must call AppendOnlyVec::config first!");
     }
 
-    static size_t water_mark() { return StoragePtr->water_mark(); }
+    static size_t num_chunks_in_use() {
+        if (IsConfigured) [[likely]] {
+            return StoragePtr->num_chunks_in_use();
+        }
+        throw std::logic_error("Must call AppendOnlyVec::config first!");
+    }
+
+    static size_t water_mark() {
+        if (IsConfigured) [[likely]] {
+            return StoragePtr->water_mark();
+        }
+        throw std::logic_error("Must call AppendOnlyVec::config first!");
+    }
+
+    static ChunkStorageStats stats() {  // of the default storage
+        if (IsConfigured) [[likely]] {
+            return StoragePtr->stats();
+        }
+        throw std::logic_error("Must call AppendOnlyVec::config first!");
+    }
 
     AppendOnlyVec(AppendOnlyVec const&) = delete;  // copy ctor not allowed
 
-    AppendOnlyVec(AppendOnlyVec&& o) {
-        this->chunks_.swap(o.chunks_);
-        last_chunk_idx_ = o.last_chunk_idx_;
-        o.last_chunk_idx_ = 0; // b/c this is ctor
+    AppendOnlyVec(AppendOnlyVec&& o) : storage_(o.storage_) {  // o stays usable with the same storage
+        swap(o);
     }
 
     ~AppendOnlyVec() {
-        for (auto& c : chunks_) {
-            c.clear();
-            StoragePtr->return_chunk(c);
+        release_retired(retired_.size());  // no reader left
+        destroy_elements();
+        for (size_type c = free_chunk_; c < num_chunks_; ++c) {
+            storage_->return_chunk(Chunk::of(slot(c)));
         }
+        delete[] readers_.load(std::memory_order_relaxed);
     }
 
     AppendOnlyVec& operator = (AppendOnlyVec const&) = delete;
 
     AppendOnlyVec& operator = (AppendOnlyVec&& o) {
         clear();
-        this->chunks_.swap(o.chunks_);
-        last_chunk_idx_ = o.last_chunk_idx_;
-        o.last_chunk_idx_ = 0; // b/c clear()
+        swap(o);
         return *this;
     }
 
-    size_type size() const {
-        if (chunks_.size() == 0) return 0;
-        return last_chunk_idx_ * ChunkSize + chunks_[last_chunk_idx_].size();
-    }
+    // published size, elements at index below it are safe to read from any thread
+    size_type size() const { return size_.load(std::memory_order_acquire); }
 
-    bool empty() const { return !size(); }
+    bool empty() const { return size() == oldest_index(); }
 
-    size_type capacity() const { return ChunkSize * chunks_.capacity(); }
+    // index of the oldest element not retired, 0 unless retire_until() is used
+    size_type oldest_index() const { return oldest_.load(std::memory_order_seq_cst); }
 
+    // number of elements the directory can hold without growing, counting from oldest_index()
+    size_type capacity() const { return ChunkSize * dir_capacity_; }
+
+    // num_chunks is rounded up to a power of 2
     void reserve(size_type num_chunks) {
-        chunks_.reserve(num_chunks);
+        if (num_chunks > dir_capacity_) grow_dir(std::bit_ceil(num_chunks));
     }
 
+    // chunks not retired are kept for reuse, retired ones go back to the storage
     void clear() {
-        for (auto& c : chunks_) c.clear();
-        last_chunk_idx_ = 0;
+        release_retired(retired_.size());
+        destroy_elements();
+        // renumber kept chunks from 0, no reader is allowed meanwhile
+        std::vector<T*> kept;
+        for (size_type c = free_chunk_; c < num_chunks_; ++c) kept.push_back(slot(c));
+        for (size_type c = 0; c < kept.size(); ++c) dir_slots_[c & dir_mask()] = kept[c];
+        free_chunk_ = first_chunk_ = next_chunk_idx_ = 0;
+        num_chunks_ = kept.size();
+        cur_ = end_ = nullptr;
+        oldest_.store(0, std::memory_order_seq_cst);
+        size_.store(0, std::memory_order_release);
     }
 
     T& operator[](size_type i) {
         assert(i < size());
-        auto chunk_i = i >> shift_n;  // divided by ChunkSize
-        return chunks_[chunk_i][i & (ChunkSize-1)]; // modularized by ChunkSize
+        T* const* dir = dir_.load(std::memory_order_acquire);
+        return dir[(i >> shift_n) & dir_mask(dir)][i & (ChunkSize-1)];  // chunk i / ChunkSize in the ring, i % ChunkSize in chunk
     }
 
     T const& operator[](size_type i) const {
         return (*const_cast<AppendOnlyVec*>(this))[i];
     }
 
-    T&       front()       { return (*this)[0]; }
-    T const& front() const { return (*this)[0]; }
+    T&       front()       { return (*this)[oldest_index()]; }
+    T const& front() const { return (*this)[oldest_index()]; }
 
     T&       back()        { return (*this)[size()-1]; }
     T const& back()  const { return (*this)[size()-1]; }
 
-    iterator begin()  { return make_iter(0); }
+    iterator begin()  { return make_iter(oldest_index()); }
     iterator end()    { return make_iter(size()); }
 
-    const_iterator begin() const { return make_iter(0); }
+    const_iterator begin() const { return make_iter(oldest_index()); }
     const_iterator end()   const { return make_iter(size()); }
 
-    const_iterator cbegin() const { return make_iter(0); }
+    const_iterator cbegin() const { return make_iter(oldest_index()); }
     const_iterator cend()   const { return make_iter(size()); }
 
     iterator rbegin()  { return make_iter(size()-1); }
-    iterator rend()    { return make_iter(0-1); }  // Note -1 == unsigned(0)-1
+    iterator rend()    { return make_iter(oldest_index()-1); }  // Note -1 == unsigned(0)-1
 
     const_iterator rbegin() const { return make_iter(size()-1); }
-    const_iterator rend()   const { return make_iter(0-1); }
+    const_iterator rend()   const { return make_iter(oldest_index()-1); }
 
     const_iterator crbegin() const { return make_iter(size()-1); }
-    const_iterator crend()   const { return make_iter(0-1); }
+    const_iterator crend()   const { return make_iter(oldest_index()-1); }
+
+    // Chunks of the elements published so far, e.g.
+    //   for (std::span<double const> s : vec.chunks()) sum = std::accumulate(s.begin(), s.end(), sum);
+    // See also wcc::for_each, wcc::transform_reduce and wcc::lower_bound below.
+    ChunkRange<T, ChunkSize> chunks() {
+        size_type first = oldest_index() >> shift_n, n = size();
+        T* const* dir = dir_.load(std::memory_order_acquire);
+        return {dir, dir ? dir_mask(dir) : 0, first, n};
+    }
+    ChunkRange<T const, ChunkSize> chunks() const {
+        size_type first = oldest_index() >> shift_n, n = size();
+        T* const* dir = dir_.load(std::memory_order_acquire);
+        return {dir, dir ? dir_mask(dir) : 0, first, n};
+    }
 
     void push_back(T const& t) {
-        if (chunks_.size() == 0) new_chunk();
-        if (chunks_[last_chunk_idx_].size() == ChunkSize) ++last_chunk_idx_;
-        if (chunks_.size() == last_chunk_idx_) new_chunk();
-        chunks_[last_chunk_idx_].push_back(t);
+        emplace_back(t);
     }
 
     template <typename... Args>
     reference emplace_back(Args&&... args) {
-        if (chunks_.size() == 0) new_chunk();                                 // there nothing, add a new chunk
-        if (chunks_[last_chunk_idx_].size() == ChunkSize) ++last_chunk_idx_; // current chunk full, move to next
-        if (chunks_.size() == last_chunk_idx_) new_chunk();                   // there's no next chunk, add a new one
-        chunks_[last_chunk_idx_].emplace_back(std::forward<Args>(args)...);
-        return chunks_[last_chunk_idx_].back();
+        if (cur_ == end_) [[unlikely]] next_chunk();  // empty or current chunk full
+        T* p = std::construct_at(cur_, std::forward<Args>(args)...);
+        ++cur_;
+        size_.store(size_.load(std::memory_order_relaxed) + 1, std::memory_order_release);  // publish
+        return *p;
+    }
+
+    // Appends elements of s chunk by chunk, by memcpy for trivially copyable T.
+    // Size is published once per chunk filled.
+    void append(std::span<const T> s) {
+        append_range(s.begin(), s.end());
+    }
+
+    template <std::input_iterator It, std::sentinel_for<It> Sentinel>
+    void append_range(It first, Sentinel last) {
+        if constexpr (std::sized_sentinel_for<Sentinel, It> && std::random_access_iterator<It>) {
+            for (auto n = size_type(last - first); n; ) {
+                if (cur_ == end_) next_chunk();
+                size_type k = std::min(n, size_type(end_ - cur_));
+                if constexpr (std::contiguous_iterator<It> && std::is_trivially_copyable_v<T>
+                              && std::is_same_v<std::iter_value_t<It>, T>) {
+                    std::memcpy(cur_, std::to_address(first), k * sizeof(T));
+                } else {
+                    std::uninitialized_copy_n(first, k, cur_);
+                }
+                first += k;
+                n -= k;
+                cur_ += k;
+                size_.store(size_.load(std::memory_order_relaxed) + k, std::memory_order_release);  // publish
+            }
+        } else {
+            for (; first != last; ++first) emplace_back(*first);
+        }
+    }
+
+    // Appends at most n default-initialized elements, as many as fit in the current chunk
+    // (or a new one if it is full), and returns them for the caller to fill in place, e.g.
+    //   for (size_t n = count; n; ) {
+    //       auto s = vec.emplace_n(n);
+    //       fill(s.data(), s.size());
+    //       n -= s.size();
+    //   }
+    // Like emplace_back, the elements are published at once, so readers on other threads
+    // may see them before they are filled.
+    std::span<T> emplace_n(size_type n) {
+        if (n == 0) return {};
+        if (cur_ == end_) next_chunk();
+        size_type k = std::min(n, size_type(end_ - cur_));
+        std::uninitialized_default_construct_n(cur_, k);
+        std::span<T> s(cur_, k);
+        cur_ += k;
+        size_.store(size_.load(std::memory_order_relaxed) + k, std::memory_order_release);  // publish
+        return s;
+    }
+
+    // Writer only. Retires the whole chunks below index, which must not exceed size(),
+    // and returns the new oldest_index(). Retired chunks go back to the storage once
+    // readers holding a read_guard() taken before have released it.
+    size_type retire_until(size_type index) {
+        assert(index <= size());
+        size_type end_chunk = index >> shift_n;  // chunks before it are full
+        if (end_chunk > first_chunk_) {
+            oldest_.store(end_chunk * ChunkSize, std::memory_order_seq_cst);
+            uint64_t epoch = epoch_.fetch_add(1, std::memory_order_seq_cst);
+            retired_.push_back(Retired{end_chunk, epoch});
+            first_chunk_ = end_chunk;
+        }
+        reclaim();
+        return first_chunk_ * ChunkSize;
+    }
+
+    // Writer only. Returns retired chunks no reader may still use, also done by
+    // retire_until() and when the directory is full.
+    void reclaim() {
+        if (retired_.empty()) return;
+        uint64_t min_epoch = UINT64_MAX;  // oldest epoch a reader entered at
+        if (ReaderSlot* readers = readers_.load(std::memory_order_seq_cst)) {
+            for (size_t i = 0; i < k_max_readers; ++i) {
+                uint64_t e = readers[i].epoch.load(std::memory_order_seq_cst);
+                if (e) min_epoch = std::min(min_epoch, e);
+            }
+        }
+        size_type n = 0;
+        while (n < retired_.size() && retired_[n].epoch < min_epoch) ++n;
+        release_retired(n);
+    }
+
+    // Reader side. While the guard lives, elements at oldest_index() (loaded after the
+    // guard is taken) and above stay valid. Only needed if the writer retires chunks.
+    ReadGuard read_guard() const {
+        ReaderSlot* readers = readers_.load(std::memory_order_seq_cst);
+        if (!readers) [[unlikely]] {
+            auto* fresh = new ReaderSlot[k_max_readers];
+            if (readers_.compare_exchange_strong(readers, fresh, std::memory_order_seq_cst)) readers = fresh;
+            else delete[] fresh;
+        }
+        uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+        for (size_t i = 0; i < k_max_readers; ++i) {
+            uint64_t idle = 0;
+            if (readers[i].epoch.compare_exchange_strong(idle, epoch, std::memory_order_seq_cst)) {
+                return ReadGuard(&readers[i].epoch);
+            }
+        }
+        throw std::runtime_error("AppendOnlyVec,TooManyReaders");
     }
 
 private:
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch = 0;  // epoch the reader entered at, 0 if idle
+    };
+
+    struct Retired {
+        size_type end_chunk;  // chunks [free_chunk_, end_chunk) are retired
+        uint64_t epoch;       // readers entered at this epoch or before may use them
+    };
+
+    T*& slot(size_type c) { return dir_slots_[c & dir_mask()]; }
+    size_type dir_mask() const { return dir_capacity_ - 1; }
+
+    // The directory is a ring of chunk data pointers, chunk c at dir[c & mask], with the mask
+    // stored in dir[-1] so that a reader finds both from a single load of dir_.
+    static size_type dir_mask(T* const* dir) { return static_cast<size_type>(reinterpret_cast<uintptr_t>(dir[-1])); }
+
+    void next_chunk() {
+        if (next_chunk_idx_ == num_chunks_) new_chunk();  // no chunk left from before clear(), take a new one
+        cur_ = slot(next_chunk_idx_++);
+        end_ = cur_ + ChunkSize;
+    }
+
     void new_chunk() {
-        chunks_.emplace_back(std::move(StoragePtr->new_chunk()));
+        if (num_chunks_ - free_chunk_ == dir_capacity_) {
+            reclaim();  // may free ring slots
+            if (num_chunks_ - free_chunk_ == dir_capacity_) grow_dir(std::max<size_type>(2 * dir_capacity_, 1));
+        }
+        slot(num_chunks_) = storage_->new_chunk()->data();
+        ++num_chunks_;
+    }
+
+    // returns the first n batches of retired chunks to storage
+    void release_retired(size_type n) {
+        for (size_type b = 0; b < n; ++b) {
+            for (; free_chunk_ < retired_[b].end_chunk; ++free_chunk_) {
+                T* data = slot(free_chunk_);
+                if constexpr (!std::is_trivially_destructible_v<T>) std::destroy_n(data, ChunkSize);
+                storage_->return_chunk(Chunk::of(data));
+            }
+        }
+        retired_.erase(retired_.begin(), retired_.begin() + n);
+    }
+
+    // elements not retired
+    void destroy_elements() {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            size_type n = size_.load(std::memory_order_relaxed) - first_chunk_ * ChunkSize;
+            for (size_type c = first_chunk_; n; ++c) {
+                size_type k = std::min(n, ChunkSize);
+                std::destroy_n(slot(c), k);
+                n -= k;
+            }
+        }
+    }
+
+    // publish a larger copy of the directory, the old one is kept alive for readers still using it
+    void grow_dir(size_type num_chunks) {
+        auto entries = std::make_unique<T*[]>(num_chunks + 1);
+        entries[0] = reinterpret_cast<T*>(uintptr_t(num_chunks - 1));  // mask
+        T** slots = entries.get() + 1;
+        for (size_type c = free_chunk_; c < num_chunks_; ++c) slots[c & (num_chunks - 1)] = slot(c);
+        dir_slots_ = slots;
+        dir_capacity_ = num_chunks;
+        dir_.store(slots, std::memory_order_release);
+        dirs_.push_back(std::move(entries));
+    }
+
+    void swap(AppendOnlyVec& o) {
+        storage_.swap(o.storage_);
+        dirs_.swap(o.dirs_);
+        retired_.swap(o.retired_);
+        std::swap(cur_, o.cur_);
+        std::swap(end_, o.end_);
+        std::swap(next_chunk_idx_, o.next_chunk_idx_);
+        std::swap(num_chunks_, o.num_chunks_);
+        std::swap(first_chunk_, o.first_chunk_);
+        std::swap(free_chunk_, o.free_chunk_);
+        std::swap(dir_slots_, o.dir_slots_);
+        std::swap(dir_capacity_, o.dir_capacity_);
+        dir_.store(o.dir_.exchange(dir_.load(std::memory_order_relaxed)), std::memory_order_release);
+        size_.store(o.size_.exchange(size_.load(std::memory_order_relaxed)), std::memory_order_release);
+        oldest_.store(o.oldest_.exchange(oldest_.load(std::memory_order_relaxed)), std::memory_order_seq_cst);
+        epoch_.store(o.epoch_.exchange(epoch_.load(std::memory_order_relaxed)), std::memory_order_seq_cst);
+        readers_.store(o.readers_.exchange(readers_.load(std::memory_order_relaxed)), std::memory_order_seq_cst);
     }
 
     auto make_iter(size_type i) const { return const_iterator(*this, i); }
@@ -296,13 +835,74 @@ private:
         return i-1;
     }();
 
-    size_type last_chunk_idx_ = 0; // depends on if chunks_.size() <> 0
-    std::vector<Chunk> chunks_;
-
-    inline static std::unique_ptr<ChunkStorage<Chunk>> StoragePtr;
+    // writer side
+    T* cur_ = nullptr;              // where the next element goes
+    T* end_ = nullptr;              // end of the current chunk
+    size_type next_chunk_idx_ = 0;  // chunk to write after the current one is full
+    size_type num_chunks_ = 0;      // chunks [free_chunk_, num_chunks_) are taken from storage_, returned on destruction
+    size_type first_chunk_ = 0;     // oldest chunk not retired
+    size_type free_chunk_ = 0;      // oldest chunk not returned to storage_
+    std::deque<Retired> retired_;   // in retiring order
+    std::vector<std::unique_ptr<T*[]>> dirs_;  // all directories ever published, last one is current
+    T** dir_slots_ = nullptr;       // slots of the current directory
+    size_type dir_capacity_ = 0;
+
+    // reader side
+    std::atomic<T* const*> dir_ = nullptr;    // ring of chunk data pointers, see dir_mask()
+    std::atomic<size_type> size_ = 0;         // published size
+    std::atomic<size_type> oldest_ = 0;       // index of the oldest element not retired
+    std::atomic<uint64_t> epoch_ = 1;         // bumped by every retire_until()
+    mutable std::atomic<ReaderSlot*> readers_ = nullptr;  // allocated by the first read_guard()
+
+    std::shared_ptr<storage_type> storage_;
+
+    inline static std::shared_ptr<storage_type> StoragePtr;  // default storage
     inline static bool IsConfigured = false;
 protected:
     inline static uint32_t NumChunks = 1024;
 };
 
+//===============================================================================
+// Segmented algorithms, running a tight loop per chunk
+//===============================================================================
+template <typename T, size_t ChunkSize, typename F>
+F for_each(AppendOnlyVec<T, ChunkSize>& vec, F f) {
+    for (std::span<T> s : vec.chunks()) {
+        for (T& x : s) f(x);
+    }
+    return f;
+}
+
+template <typename T, size_t ChunkSize, typename F>
+F for_each(AppendOnlyVec<T, ChunkSize> const& vec, F f) {
+    for (std::span<T const> s : vec.chunks()) {
+        for (T const& x : s) f(x);
+    }
+    return f;
+}
+
+// reduce must be associative and commutative, as for std::transform_reduce, e.g.
+//   double notional = wcc::transform_reduce(trades, 0.0, std::plus<>(), [](Trade const& t) { return t.price * t.qty; });
+template <typename T, size_t ChunkSize, typename Init, typename Reduce, typename Transform>
+Init transform_reduce(AppendOnlyVec<T, ChunkSize> const& vec, Init init, Reduce reduce, Transform transform) {
+    for (std::span<T const> s : vec.chunks()) init = std::transform_reduce(s.begin(), s.end(), std::move(init), reduce, transform);
+    return init;
+}
+
+// vec must be sorted by comp. Binary search on the last element of chunks, then within one chunk.
+template <typename T, size_t ChunkSize, typename Value, typename Compare = std::less<>>
+auto lower_bound(AppendOnlyVec<T, ChunkSize> const& vec, Value const& value, Compare comp = {}) {
+    auto chunks = vec.chunks();
+    size_t lo = 0, hi = chunks.size();  // first chunk whose last element is not less than value
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (comp(chunks[mid].back(), value)) lo = mid + 1;
+        else hi = mid;
+    }
+    using const_iterator = typename AppendOnlyVec<T, ChunkSize>::const_iterator;
+    if (lo == chunks.size()) return const_iterator(vec, chunks.end_index());
+    std::span<T const> s = chunks[lo];
+    return const_iterator(vec, chunks.first_index() + lo * ChunkSize + (std::lower_bound(s.begin(), s.end(), value, comp) - s.begin()));
+}
+
 }  // namespace wcc
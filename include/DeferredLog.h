@@ -0,0 +1,478 @@
+/**
+ * @file DeferredLog.h
+ * @brief Deferred-formatting backend behind the LogConfig log_* functions and the HJ macros.
+ *
+ * A logging thread only copies the format string pointer, a decoder function pointer and
+ * the raw argument bytes into its own SPSC ring. A background thread merges all rings by
+ * timestamp, formats with fmt and hands the text to the logger's sinks, so the pattern,
+ * level and flush_on settings done by config_log still apply.
+ *
+ * Arguments are stored by value: strings (char pointers, std::string, std::string_view) are
+ * copied inline, arithmetic and enum values are copied as bytes. A call with any other
+ * argument type (which may point to memory the caller changes or frees, e.g. fmt::join or
+ * a struct holding a string_view) is formatted on the calling thread and only the text is
+ * deferred. Compile-time format strings have static storage and are kept by pointer, while
+ * the text of an fmt::runtime format, which may be a temporary, is copied into the record.
+ *
+ * With "clock: tsc" records are stamped with the raw TSC (TscClock::now()) instead of
+ * log_clock::now(), and the backend thread converts them to wall time, recalibrating the
+ * conversion against CLOCK_REALTIME every tsc_recalibrate_interval. Records of one thread
+ * keep their order; ordering across threads assumes an invariant, synchronized TSC.
+ *
+ * Selected with "backend: deferred" in the config_log yaml.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fmt/format.h>
+#include <spdlog/logger.h>
+#include "TscClock.h"
+
+namespace wcc {
+
+namespace internal {
+
+template <typename T>
+constexpr bool is_deferred_string_v =
+    std::is_same_v<T, const char*> || std::is_same_v<T, char*> ||
+    std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+
+// Types that can be copied into the ring and formatted later on the backend thread: values
+// that do not refer to other memory, and the strings deep-copied by deferred_arg
+template <typename T>
+constexpr bool is_deferrable_v = is_deferred_string_v<T> || std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+template <typename T, typename = void>
+struct deferred_arg {  // raw bytes
+    using decoded_type = T;
+    static size_t size(T const&) { return sizeof(T); }
+    static std::byte* encode(std::byte* p, T const& v) {
+        std::memcpy(p, &v, sizeof(T));
+        return p + sizeof(T);
+    }
+    static T decode(std::byte const*& p) {
+        std::array<std::byte, sizeof(T)> raw;
+        std::memcpy(raw.data(), p, sizeof(T));
+        p += sizeof(T);
+        return std::bit_cast<T>(raw);
+    }
+};
+
+template <typename T>
+struct deferred_arg<T, std::enable_if_t<is_deferred_string_v<T>>> {  // length + chars
+    using decoded_type = std::string_view;
+    static std::string_view view(T const& v) {
+        if constexpr (std::is_pointer_v<T>) return v ? std::string_view(v) : std::string_view();
+        else return std::string_view(v);
+    }
+    static size_t size(T const& v) { return sizeof(uint32_t) + view(v).size(); }
+    static std::byte* encode(std::byte* p, T const& v) {
+        auto sv = view(v);
+        uint32_t n = static_cast<uint32_t>(sv.size());
+        std::memcpy(p, &n, sizeof(n));
+        std::memcpy(p + sizeof(n), sv.data(), n);
+        return p + sizeof(n) + n;
+    }
+    static std::string_view decode(std::byte const*& p) {
+        uint32_t n;
+        std::memcpy(&n, p, sizeof(n));
+        std::string_view sv(reinterpret_cast<const char*>(p + sizeof(n)), n);
+        p += sizeof(n) + n;
+        return sv;
+    }
+};
+
+using runtime_format_t = decltype(fmt::runtime(fmt::string_view()));  // fmt::runtime() result
+
+using DeferredFormatFn = void (*)(fmt::string_view fmt, std::byte const* args, fmt::memory_buffer& out);
+
+// One instantiation per argument pack; its format() is the decoder stored in each record
+template <typename... Args>
+struct DeferredCodec {
+    static size_t size(Args const&... args) { return (size_t{0} + ... + deferred_arg<Args>::size(args)); }
+
+    // p is unused for an empty Args
+    static void encode([[maybe_unused]] std::byte* p, Args const&... args) { ((p = deferred_arg<Args>::encode(p, args)), ...); }
+
+    static void format(fmt::string_view fmt, [[maybe_unused]] std::byte const* p, fmt::memory_buffer& out) {
+        // braced init: decoded left to right
+        std::tuple<typename deferred_arg<Args>::decoded_type...> values{deferred_arg<Args>::decode(p)...};
+        std::apply([&](auto const&... v) {
+            fmt::vformat_to(std::back_inserter(out), fmt, fmt::make_format_args(v...));
+        }, values);
+    }
+};
+
+struct DeferredRecord {
+    uint32_t size;                      // bytes including this header, multiple of 8; 0 marks a wrap
+    spdlog::level::level_enum level;
+    spdlog::logger* logger;
+    DeferredFormatFn format;            // nullptr: the payload is the formatted text of fmt_size bytes
+    const char* fmt_data;               // else the format string, nullptr: copied in front of the args
+    size_t fmt_size;
+    int64_t time;                       // spdlog::log_clock ticks, or TscClock ticks with DeferredLogOptions::tsc
+};
+
+// Byte ring with one producer (the logging thread) and one consumer (the backend thread)
+class DeferredRing {
+public:
+    explicit DeferredRing(size_t capacity)
+        : capacity_(std::bit_ceil(std::max<size_t>(capacity, 4096))),
+          buf_(std::make_unique<uint64_t[]>(capacity_ / sizeof(uint64_t))) {}
+
+    size_t capacity() const { return capacity_; }
+
+    // Producer: n must be a multiple of 8 and at most capacity() / 2. Returns nullptr if full
+    std::byte* try_reserve(size_t n) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        size_t pos = head & (capacity_ - 1);
+        size_t gap = capacity_ - pos < n ? capacity_ - pos : 0;  // skipped tail end on wrap
+        if (head + gap + n - cached_tail_ > capacity_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head + gap + n - cached_tail_ > capacity_) return nullptr;
+        }
+        if (gap) {
+            uint32_t wrap = 0;
+            std::memcpy(data() + pos, &wrap, sizeof(wrap));
+            pos = 0;
+        }
+        pending_gap_ = gap;
+        return data() + pos;
+    }
+
+    void commit(size_t n) {
+        head_.store(head_.load(std::memory_order_relaxed) + pending_gap_ + n, std::memory_order_release);
+    }
+
+    // Consumer: oldest record or nullptr if empty
+    DeferredRecord const* front() {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            if (tail == cached_head_ && tail == (cached_head_ = head_.load(std::memory_order_acquire)))
+                return nullptr;
+            size_t pos = tail & (capacity_ - 1);
+            uint32_t size;
+            std::memcpy(&size, data() + pos, sizeof(size));
+            if (size != 0) return reinterpret_cast<DeferredRecord const*>(data() + pos);
+            tail += capacity_ - pos;
+            tail_.store(tail, std::memory_order_release);
+        }
+    }
+
+    void pop(DeferredRecord const* rec) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + rec->size, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+    // Monotonic byte positions: everything produced before produced() == m is consumed once consumed() >= m
+    uint64_t produced() const { return head_.load(std::memory_order_acquire); }
+    uint64_t consumed() const { return tail_.load(std::memory_order_acquire); }
+
+    std::atomic<bool> closed{false};  // set when the producing thread exits
+
+private:
+    std::byte* data() { return reinterpret_cast<std::byte*>(buf_.get()); }
+
+    size_t capacity_;
+    std::unique_ptr<uint64_t[]> buf_;
+    alignas(64) std::atomic<uint64_t> head_{0};
+    uint64_t cached_tail_ = 0;
+    size_t pending_gap_ = 0;
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    uint64_t cached_head_ = 0;
+};
+
+} // namespace internal
+
+struct DeferredLogOptions {
+    size_t queue_size = 1 << 20;   // bytes of each per-thread ring
+    bool block = true;             // on a full ring: wait for the backend (true) or drop the record
+    std::chrono::microseconds poll_interval{100};  // backend sleep when all rings are empty
+    bool tsc = false;              // stamp records with TscClock instead of log_clock
+    std::chrono::milliseconds tsc_recalibrate_interval{1000};
+};
+
+class DeferredLogBackend {
+public:
+    explicit DeferredLogBackend(DeferredLogOptions const& opts = {})
+        : opts_(opts), id_(next_id()), tsc_clock_(opts.tsc ? std::make_optional<TscClock>() : std::nullopt),
+          worker_([this] { run(); }) {}
+
+    DeferredLogBackend(DeferredLogBackend const&) = delete;
+    DeferredLogBackend& operator=(DeferredLogBackend const&) = delete;
+
+    ~DeferredLogBackend() {
+        stop_.store(true, std::memory_order_release);
+        worker_.join();
+    }
+
+    // The caller has already checked logger->should_log(lvl). A compile-time format string
+    // has static storage, so only its pointer is queued.
+    template <typename... Args>
+    void log(spdlog::logger* logger, spdlog::level::level_enum lvl,
+             fmt::format_string<Args...> fmt, Args&&... args) {
+        log_impl(logger, lvl, fmt, false, std::forward<Args>(args)...);
+    }
+
+    // The text of a runtime format may not outlive the call, so it is copied into the record
+    template <typename... Args>
+    void log(spdlog::logger* logger, spdlog::level::level_enum lvl,
+             internal::runtime_format_t fmt, Args&&... args) {
+        log_impl(logger, lvl, fmt::format_string<Args...>(fmt), true, std::forward<Args>(args)...);
+    }
+
+    // Wait until every record queued before the call has been handed to the sinks; records
+    // other threads queue meanwhile are not waited for, so steady logging cannot starve it
+    void drain() const {
+        std::vector<std::pair<std::shared_ptr<internal::DeferredRing>, uint64_t>> marks;
+        {
+            std::lock_guard lock(mutex_);
+            marks.reserve(rings_.size());
+            for (auto const& r : rings_) marks.emplace_back(r, r->produced());
+        }
+        for (auto const& [r, mark] : marks) wait_consumed(*r, mark);
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    template <typename... Args>
+    void log_impl(spdlog::logger* logger, spdlog::level::level_enum lvl,
+                  fmt::format_string<Args...> fmt, bool copy_fmt, Args&&... args) {
+        int64_t now = opts_.tsc ? static_cast<int64_t>(TscClock::now())
+                                : spdlog::log_clock::now().time_since_epoch().count();
+        if constexpr ((internal::is_deferrable_v<std::decay_t<Args>> && ...)) {
+            using Codec = internal::DeferredCodec<std::decay_t<Args>...>;
+            fmt::string_view fmt_sv = fmt;
+            size_t fmt_copy = copy_fmt ? fmt_sv.size() : 0;
+            size_t n = record_size(fmt_copy + Codec::size(args...));
+            if (n > ring().capacity() / 2) [[unlikely]] {  // too large for the ring, log synchronously in order
+                drain_own();
+                logger->log(lvl, fmt, std::forward<Args>(args)...);
+                return;
+            }
+            auto* rec = reserve(logger, lvl, now, n);
+            if (rec == nullptr) return;
+            rec->format = &Codec::format;
+            rec->fmt_data = copy_fmt ? nullptr : fmt_sv.data();
+            rec->fmt_size = fmt_sv.size();
+            auto* payload = reinterpret_cast<std::byte*>(rec + 1);
+            std::memcpy(payload, fmt_sv.data(), fmt_copy);
+            Codec::encode(payload + fmt_copy, args...);
+            ring().commit(rec->size);
+        } else {
+            fmt::memory_buffer buf;
+            fmt::format_to(std::back_inserter(buf), fmt, std::forward<Args>(args)...);
+            size_t n = record_size(buf.size());
+            if (n > ring().capacity() / 2) [[unlikely]] {
+                drain_own();
+                logger->log(lvl, std::string_view(buf.data(), buf.size()));
+                return;
+            }
+            auto* rec = reserve(logger, lvl, now, n);
+            if (rec == nullptr) return;
+            rec->format = nullptr;
+            rec->fmt_data = nullptr;
+            rec->fmt_size = buf.size();
+            std::memcpy(rec + 1, buf.data(), buf.size());
+            ring().commit(rec->size);
+        }
+    }
+
+    struct RingHandle {
+        std::shared_ptr<internal::DeferredRing> ring;
+        uint64_t owner = 0;
+        ~RingHandle() { if (ring) ring->closed.store(true, std::memory_order_release); }
+    };
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> id{0};
+        return ++id;
+    }
+
+    internal::DeferredRing& ring() {
+        thread_local RingHandle handle;
+        if (handle.owner != id_) [[unlikely]] {
+            if (handle.ring) handle.ring->closed.store(true, std::memory_order_release);
+            handle.ring = std::make_shared<internal::DeferredRing>(opts_.queue_size);
+            handle.owner = id_;
+            std::lock_guard lock(mutex_);
+            rings_.push_back(handle.ring);
+            version_.fetch_add(1, std::memory_order_release);
+        }
+        return *handle.ring;
+    }
+
+    static void wait_consumed(internal::DeferredRing const& r, uint64_t mark) {
+        while (r.consumed() < mark) std::this_thread::yield();
+    }
+
+    // Wait for the calling thread's own records only, before logging one synchronously
+    void drain_own() {
+        auto& r = ring();
+        wait_consumed(r, r.produced());
+    }
+
+    static size_t record_size(size_t payload) {
+        return (sizeof(internal::DeferredRecord) + payload + 7) & ~size_t{7};
+    }
+
+    // Returns nullptr if the ring is full and records are dropped rather than waited for
+    internal::DeferredRecord* reserve(spdlog::logger* logger, spdlog::level::level_enum lvl,
+                                      int64_t now, size_t n) {
+        auto& r = ring();
+        std::byte* p;
+        while ((p = r.try_reserve(n)) == nullptr) {
+            if (!opts_.block) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            std::this_thread::yield();
+        }
+        auto* rec = reinterpret_cast<internal::DeferredRecord*>(p);
+        rec->size = static_cast<uint32_t>(n);
+        rec->level = lvl;
+        rec->logger = logger;
+        rec->time = now;
+        return rec;
+    }
+
+    void run() {
+        auto calibrated = std::chrono::steady_clock::now();
+        while (!stop_.load(std::memory_order_acquire)) {
+            if (tsc_clock_ && std::chrono::steady_clock::now() - calibrated >= opts_.tsc_recalibrate_interval) {
+                tsc_clock_->recalibrate();
+                calibrated = std::chrono::steady_clock::now();
+            }
+            if (!process()) std::this_thread::sleep_for(opts_.poll_interval);
+        }
+        while (process()) {}
+    }
+
+    // Hand queued records to the sinks, oldest first across all rings
+    bool process() {
+        if (seen_version_ != version_.load(std::memory_order_acquire)) {
+            std::lock_guard lock(mutex_);
+            seen_version_ = version_.load(std::memory_order_relaxed);
+            active_ = rings_;
+        }
+
+        size_t n = 0;
+        for (; n < k_batch; ++n) {
+            internal::DeferredRing* best = nullptr;
+            internal::DeferredRecord const* best_rec = nullptr;
+            for (auto const& r : active_) {
+                auto const* rec = r->front();
+                if (rec && (best_rec == nullptr || rec->time < best_rec->time)) {
+                    best = r.get();
+                    best_rec = rec;
+                }
+            }
+            if (best == nullptr) break;
+            write(*best_rec);
+            best->pop(best_rec);
+        }
+
+        report_dropped();
+
+        // release the rings of exited threads once drained
+        bool any_closed = false;
+        for (auto const& r : active_) {
+            any_closed = any_closed || (r->closed.load(std::memory_order_acquire) && r->empty());
+        }
+        if (any_closed) {
+            std::lock_guard lock(mutex_);
+            std::erase_if(rings_, [](auto const& r) {
+                return r->closed.load(std::memory_order_acquire) && r->empty();
+            });
+            seen_version_ = version_.fetch_add(1, std::memory_order_relaxed) + 1;
+            active_ = rings_;
+        }
+        return n > 0;
+    }
+
+    void write(internal::DeferredRecord const& rec) {
+        auto const* payload = reinterpret_cast<std::byte const*>(&rec + 1);
+        std::string_view text;
+        if (rec.format) {
+            buf_.clear();
+            try {
+                if (rec.fmt_data) rec.format(fmt::string_view(rec.fmt_data, rec.fmt_size), payload, buf_);
+                else rec.format(fmt::string_view(reinterpret_cast<const char*>(payload), rec.fmt_size),
+                                payload + rec.fmt_size, buf_);
+            } catch (std::exception const& e) {
+                buf_.clear();
+                fmt::format_to(std::back_inserter(buf_), "DeferredLog,FormatError,{}", e.what());
+            }
+            text = std::string_view(buf_.data(), buf_.size());
+        } else {
+            text = std::string_view(reinterpret_cast<const char*>(payload), rec.fmt_size);
+        }
+
+        auto* logger = rec.logger;
+        spdlog::log_clock::time_point time;
+        if (tsc_clock_) {
+            time = spdlog::log_clock::time_point(std::chrono::duration_cast<spdlog::log_clock::duration>(
+                std::chrono::nanoseconds(tsc_clock_->to_ns(static_cast<uint64_t>(rec.time)))));
+        } else {
+            time = spdlog::log_clock::time_point(spdlog::log_clock::duration(rec.time));
+        }
+        spdlog::details::log_msg msg(time, spdlog::source_loc{}, logger->name(), rec.level, text);
+        for (auto& sink : logger->sinks()) {
+            if (sink->should_log(rec.level)) sink->log(msg);
+        }
+        if (rec.level >= logger->flush_level()) {
+            for (auto& sink : logger->sinks()) sink->flush();
+        }
+    }
+
+    void report_dropped() {
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported_dropped_) {
+            fmt::print(stderr, "DeferredLogBackend,Dropped,count={}\n", dropped - reported_dropped_);
+            reported_dropped_ = dropped;
+        }
+    }
+
+    static constexpr size_t k_batch = 4096;
+
+    DeferredLogOptions opts_;
+    uint64_t id_;
+    std::optional<TscClock> tsc_clock_;  // recalibrated and read by the backend thread only
+
+    mutable std::mutex mutex_;  // guards rings_
+    std::vector<std::shared_ptr<internal::DeferredRing>> rings_;
+    std::atomic<uint64_t> version_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> stop_{false};
+
+    // backend thread only
+    std::vector<std::shared_ptr<internal::DeferredRing>> active_;
+    uint64_t seen_version_ = 0;
+    uint64_t reported_dropped_ = 0;
+    fmt::memory_buffer buf_;
+
+    std::thread worker_;  // last: started after everything above is initialized
+};
+
+} // namespace wcc
@@ -0,0 +1,449 @@
+/**
+ * @file EventLog.h
+ * @brief Structured binary event log written alongside the text log by the HJ macros.
+ *
+ * Each HJ_LOG/HJ_TLOG/HJ_LOG_ID line enabled by its logger is also recorded as one binary
+ * record: time, level, logger, function, event, optional trader id and typed fields.
+ * Field names are taken at compile time from the "name:{}" format strings generated by
+ * VAR(x) (positional fields get an empty name). Values are stored in binary, never formatted;
+ * types without a binary encoding are stored as their fmt text.
+ *
+ * File layout: "WCCEVT01", then records of
+ *   u32 size | i64 time_ns | u8 level | str logger | str function | str event | u8 has_id [field id] |
+ *   u8 n_fields | n_fields x field
+ * where str = u16 length + chars and field = str name | u8 EventType | value.
+ *
+ * A logging thread only encodes its record into its own buffer; a background thread moves
+ * the buffers of all threads to the file every flush_interval, so there is no file I/O nor
+ * shared lock on the logging path. Records of one thread stay in order, while records of
+ * different threads are interleaved in batches (sort by time_ns to merge them).
+ *
+ * EventLogReader reads the records back, and to_json() turns one into a JSON line.
+ * Enabled with "event_log: true" in the config_log yaml.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include <fmt/format.h>
+
+namespace wcc {
+
+enum class EventType : uint8_t { i64, u64, f64, boolean, chr, str };
+
+using EventValue = std::variant<int64_t, uint64_t, double, bool, char, std::string>;
+
+struct EventField {
+    std::string name;
+    EventValue value;
+};
+
+struct Event {
+    int64_t time_ns = 0;  // system_clock since epoch
+    int level = 0;        // spdlog::level numbering
+    std::string logger;
+    std::string function;
+    std::string event;
+    std::optional<EventField> trader_id;
+    std::vector<EventField> fields;
+};
+
+// Compile-time description of an HJ macro call site
+template <size_t N, bool HasId>
+struct EventSite {
+    std::string_view function;
+    std::string_view event;
+    std::array<std::string_view, N> fields;
+};
+
+namespace internal {
+
+inline constexpr char k_event_log_magic[8] = {'W', 'C', 'C', 'E', 'V', 'T', '0', '1'};
+inline constexpr uint32_t k_event_max_size = 64 << 20;  // above the largest encodable record
+
+// "price:{:.2f}" -> "price"; anything not of the form name:{...} -> ""
+constexpr std::string_view event_field_name(std::string_view fmt) {
+    auto colon = fmt.find(':');
+    if (colon == std::string_view::npos || colon == 0 || colon + 1 >= fmt.size() || fmt[colon + 1] != '{')
+        return {};
+    for (char c : fmt.substr(0, colon)) {
+        if (!(c == '_' || c == '.' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
+            return {};
+    }
+    return fmt.substr(0, colon);
+}
+
+template <typename... Fmts>
+constexpr auto event_field_names(Fmts const&... fmts) {
+    return std::array<std::string_view, sizeof...(Fmts)>{event_field_name(fmts)...};
+}
+
+template <bool HasId, size_t N>
+constexpr EventSite<N, HasId> event_site(std::string_view function, std::string_view event,
+                                         std::array<std::string_view, N> const& fields) {
+    return {function, event, fields};
+}
+
+inline void put_str(std::string& buf, std::string_view sv) {
+    uint16_t n = static_cast<uint16_t>(std::min<size_t>(sv.size(), UINT16_MAX));
+    buf.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    buf.append(sv.data(), n);
+}
+
+template <typename T>
+void put_pod(std::string& buf, T v) {
+    buf.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+template <typename T>
+void put_value(std::string& buf, T const& v) {
+    using D = std::decay_t<T>;
+    if constexpr (std::is_same_v<D, bool>) {
+        put_pod(buf, EventType::boolean);
+        put_pod(buf, static_cast<uint8_t>(v));
+    } else if constexpr (std::is_same_v<D, char>) {
+        put_pod(buf, EventType::chr);
+        put_pod(buf, v);
+    } else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>) {
+        put_pod(buf, EventType::i64);
+        put_pod(buf, static_cast<int64_t>(v));
+    } else if constexpr (std::is_integral_v<D>) {
+        put_pod(buf, EventType::u64);
+        put_pod(buf, static_cast<uint64_t>(v));
+    } else if constexpr (std::is_floating_point_v<D>) {
+        put_pod(buf, EventType::f64);
+        put_pod(buf, static_cast<double>(v));
+    } else if constexpr (std::is_convertible_v<T const&, std::string_view>) {
+        put_pod(buf, EventType::str);
+        put_str(buf, std::string_view(v));
+    } else {
+        put_pod(buf, EventType::str);
+        put_str(buf, fmt::format("{}", v));
+    }
+}
+
+} // namespace internal
+
+class EventLogWriter {
+public:
+    explicit EventLogWriter(std::string const& path,
+                            std::chrono::milliseconds flush_interval = std::chrono::milliseconds(100))
+        : file_(std::fopen(path.c_str(), "wb")), id_(next_id()), flush_interval_(flush_interval) {
+        if (file_ == nullptr) throw std::runtime_error(fmt::format("EventLogWriter,OpenFailed,{}", path));
+        std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+        std::fwrite(internal::k_event_log_magic, 1, sizeof(internal::k_event_log_magic), file_);
+        worker_ = std::thread([this] { run(); });
+    }
+
+    EventLogWriter(EventLogWriter const&) = delete;
+    EventLogWriter& operator=(EventLogWriter const&) = delete;
+
+    ~EventLogWriter() {
+        {
+            std::lock_guard lock(stop_mutex_);
+            stop_ = true;
+        }
+        stop_cv_.notify_one();
+        worker_.join();
+        flush();
+        std::fclose(file_);
+    }
+
+    // args are the text log arguments: function, event, [trader id,] field values
+    template <size_t N, bool HasId, typename Fun, typename Evt, typename... Args>
+    void write(std::string_view logger, int level, EventSite<N, HasId> const& site,
+               Fun const&, Evt const&, Args const&... args) {
+        auto& tb = thread_buffer();
+        std::lock_guard lock(tb.mutex);  // contended only while the background thread takes the buffer
+        auto& buf = tb.data;
+        size_t start = buf.size();
+        internal::put_pod(buf, uint32_t{0});  // size, patched below
+        internal::put_pod(buf, int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::system_clock::now().time_since_epoch()).count()));
+        internal::put_pod(buf, static_cast<uint8_t>(level));
+        internal::put_str(buf, logger);
+        internal::put_str(buf, site.function);
+        internal::put_str(buf, site.event);
+        put_id_and_fields<HasId>(buf, site.fields, args...);
+        uint32_t size = static_cast<uint32_t>(buf.size() - start - sizeof(uint32_t));
+        std::memcpy(buf.data() + start, &size, sizeof(size));
+    }
+
+    // Write every record queued so far to the file
+    void flush() {
+        std::lock_guard lock(file_mutex_);
+        write_buffers();
+        std::fflush(file_);
+    }
+
+private:
+    struct ThreadBuffer {
+        std::mutex mutex;  // guards data
+        std::string data;
+        std::atomic<bool> closed{false};  // set when the owning thread exits
+    };
+
+    struct BufferHandle {
+        std::shared_ptr<ThreadBuffer> buffer;
+        uint64_t owner = 0;
+        ~BufferHandle() { if (buffer) buffer->closed.store(true, std::memory_order_release); }
+    };
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> id{0};
+        return ++id;
+    }
+
+    ThreadBuffer& thread_buffer() {
+        thread_local BufferHandle handle;
+        if (handle.owner != id_) [[unlikely]] {
+            if (handle.buffer) handle.buffer->closed.store(true, std::memory_order_release);
+            handle.buffer = std::make_shared<ThreadBuffer>();
+            handle.owner = id_;
+            std::lock_guard lock(buffers_mutex_);
+            buffers_.push_back(handle.buffer);
+        }
+        return *handle.buffer;
+    }
+
+    // file_mutex_ held
+    void write_buffers() {
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        {
+            std::lock_guard lock(buffers_mutex_);
+            buffers = buffers_;
+        }
+        std::vector<ThreadBuffer*> done;
+        for (auto const& b : buffers) {
+            // read before taking the data: a closed buffer gets no more records after it
+            if (b->closed.load(std::memory_order_acquire)) done.push_back(b.get());
+            {
+                std::lock_guard lock(b->mutex);
+                std::swap(b->data, out_);
+            }
+            std::fwrite(out_.data(), 1, out_.size(), file_);
+            out_.clear();
+        }
+        if (!done.empty()) {
+            std::lock_guard lock(buffers_mutex_);
+            std::erase_if(buffers_, [&done](auto const& b) {
+                return std::find(done.begin(), done.end(), b.get()) != done.end();
+            });
+        }
+    }
+
+    void run() {
+        std::unique_lock lock(stop_mutex_);
+        while (!stop_) {
+            stop_cv_.wait_for(lock, flush_interval_, [this] { return stop_; });
+            std::lock_guard file_lock(file_mutex_);
+            write_buffers();
+        }
+    }
+
+    template <bool HasId, size_t N, typename Id, typename... Fields>
+    static void put_id_and_fields(std::string& buf, std::array<std::string_view, N> const& names,
+                                  Id const& id, Fields const&... fields) {
+        if constexpr (HasId) {
+            internal::put_pod(buf, uint8_t{1});
+            internal::put_str(buf, "trader_id");
+            internal::put_value(buf, id);
+            put_fields(buf, names, fields...);
+        } else {
+            internal::put_pod(buf, uint8_t{0});
+            put_fields(buf, names, id, fields...);
+        }
+    }
+
+    template <bool HasId, size_t N>
+    static void put_id_and_fields(std::string& buf, std::array<std::string_view, N> const& names) {
+        static_assert(!HasId);
+        internal::put_pod(buf, uint8_t{0});
+        put_fields(buf, names);
+    }
+
+    template <size_t N, typename... Fields>
+    static void put_fields(std::string& buf, std::array<std::string_view, N> const& names, Fields const&... fields) {
+        static_assert(N == sizeof...(Fields), "one name per field");
+        internal::put_pod(buf, static_cast<uint8_t>(N));
+        [[maybe_unused]] size_t i = 0;
+        ((internal::put_str(buf, names[i++]), internal::put_value(buf, fields)), ...);
+    }
+
+    std::FILE* file_;
+    uint64_t id_;
+    std::chrono::milliseconds flush_interval_;
+
+    std::mutex file_mutex_;  // guards file_ and out_
+    std::string out_;
+    std::mutex buffers_mutex_;  // guards buffers_
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+    std::thread worker_;  // last: started after everything above is initialized
+};
+
+class EventLogReader {
+public:
+    explicit EventLogReader(std::string const& path) : file_(std::fopen(path.c_str(), "rb")) {
+        char magic[sizeof(internal::k_event_log_magic)];
+        if (file_ == nullptr || std::fread(magic, 1, sizeof(magic), file_) != sizeof(magic) ||
+            std::memcmp(magic, internal::k_event_log_magic, sizeof(magic)) != 0) {
+            if (file_) std::fclose(file_);
+            throw std::runtime_error(fmt::format("EventLogReader,InvalidFile,{}", path));
+        }
+    }
+
+    EventLogReader(EventLogReader const&) = delete;
+    EventLogReader& operator=(EventLogReader const&) = delete;
+
+    ~EventLogReader() { std::fclose(file_); }
+
+    // Returns false at the end of the file (or at a truncated last record);
+    // throws on a record that does not decode
+    bool next(Event& ev) {
+        uint32_t size;
+        if (std::fread(&size, sizeof(size), 1, file_) != 1) return false;
+        if (size > internal::k_event_max_size)
+            throw std::runtime_error(fmt::format("EventLogReader,CorruptRecord,size={}", size));
+        buf_.resize(size);
+        if (std::fread(buf_.data(), 1, size, file_) != size) return false;
+        p_ = buf_.data();
+        end_ = p_ + size;
+        ev.time_ns = get_pod<int64_t>();
+        ev.level = get_pod<uint8_t>();
+        ev.logger = get_str();
+        ev.function = get_str();
+        ev.event = get_str();
+        ev.trader_id.reset();
+        if (get_pod<uint8_t>()) ev.trader_id = get_field();
+        ev.fields.resize(get_pod<uint8_t>());
+        for (auto& f : ev.fields) f = get_field();
+        if (p_ != end_) corrupt("TrailingBytes");
+        return true;
+    }
+
+private:
+    [[noreturn]] void corrupt(std::string_view reason) const {
+        throw std::runtime_error(fmt::format("EventLogReader,CorruptRecord,{},offset={}", reason,
+                                             p_ - buf_.data()));
+    }
+
+    void need(size_t n) const {
+        if (static_cast<size_t>(end_ - p_) < n) corrupt("Overrun");
+    }
+
+    template <typename T>
+    T get_pod() {
+        need(sizeof(T));
+        T v;
+        std::memcpy(&v, p_, sizeof(T));
+        p_ += sizeof(T);
+        return v;
+    }
+
+    std::string get_str() {
+        auto n = get_pod<uint16_t>();
+        need(n);
+        std::string s(p_, n);
+        p_ += n;
+        return s;
+    }
+
+    EventField get_field() {
+        EventField f;
+        f.name = get_str();
+        switch (get_pod<EventType>()) {
+            case EventType::i64: f.value = get_pod<int64_t>(); break;
+            case EventType::u64: f.value = get_pod<uint64_t>(); break;
+            case EventType::f64: f.value = get_pod<double>(); break;
+            case EventType::boolean: f.value = get_pod<uint8_t>() != 0; break;
+            case EventType::chr: f.value = get_pod<char>(); break;
+            case EventType::str: f.value = get_str(); break;
+            default: corrupt("BadType");
+        }
+        return f;
+    }
+
+    std::FILE* file_;
+    std::string buf_;
+    const char* p_ = nullptr;
+    const char* end_ = nullptr;
+};
+
+namespace internal {
+
+inline void json_str(std::string& out, std::string_view sv) {
+    out += '"';
+    for (char c : sv) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) fmt::format_to(std::back_inserter(out), "\\u{:04x}", c);
+                else out += c;
+        }
+    }
+    out += '"';
+}
+
+inline void json_value(std::string& out, EventValue const& v) {
+    std::visit([&out](auto const& x) {
+        using T = std::decay_t<decltype(x)>;
+        if constexpr (std::is_same_v<T, std::string>) json_str(out, x);
+        else if constexpr (std::is_same_v<T, char>) json_str(out, std::string_view(&x, 1));
+        else if constexpr (std::is_same_v<T, double>) {
+            if (std::isfinite(x)) fmt::format_to(std::back_inserter(out), "{}", x);
+            else out += "null";  // JSON has no nan/inf
+        } else fmt::format_to(std::back_inserter(out), "{}", x);
+    }, v);
+}
+
+} // namespace internal
+
+// One JSON object per event; positional fields are named by their index ("1", "2", ...)
+inline std::string to_json(Event const& ev) {
+    std::string out = fmt::format(R"({{"time":{},"level":{},"logger":)", ev.time_ns, ev.level);
+    internal::json_str(out, ev.logger);
+    out += R"(,"function":)";
+    internal::json_str(out, ev.function);
+    out += R"(,"event":)";
+    internal::json_str(out, ev.event);
+    if (ev.trader_id) {
+        out += R"(,"trader_id":)";
+        internal::json_value(out, ev.trader_id->value);
+    }
+    out += R"(,"fields":{)";
+    for (size_t i = 0; i < ev.fields.size(); ++i) {
+        if (i) out += ',';
+        internal::json_str(out, ev.fields[i].name.empty() ? std::to_string(i + 1) : ev.fields[i].name);
+        out += ':';
+        internal::json_value(out, ev.fields[i].value);
+    }
+    out += "}}";
+    return out;
+}
+
+} // namespace wcc
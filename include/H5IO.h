@@ -10,20 +10,97 @@
 #include "NumericTime.h"
 
 #include <hdf5.h>
+#include <algorithm>
+#include <concepts>
+#include <array>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <ranges>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace wcc {
 
+//===============================================================================
+// String types
+//===============================================================================
+// FixedString: string of at most N chars stored in place as char[N], null padded when
+// shorter than N (and not null terminated when N chars long).
+// It is mapped to hdf5 fixed length string of size N, thus a column of FixedString<N>
+// is read by H5Dread into memory directly, which is the fast path for short symbols
+// like instrument codes or exchange ids. std::array<char, N> is mapped the same way.
+// e.g.
+//   std::vector<FixedString<8>> codes{"600000", "000001"};
+//   h5_write_vector(file_id, "/Data/code", codes);
+template<std::size_t N>
+struct FixedString {
+    static constexpr std::size_t capacity = N;
+
+    FixedString() noexcept = default;
+    FixedString(std::string_view str) noexcept { assign(str); }
+    FixedString(const char* str) noexcept : FixedString(std::string_view(str)) {}
+
+    void assign(std::string_view str) noexcept {
+        std::size_t len = std::min(N, str.size());
+        std::memcpy(chars, str.data(), len);
+        std::memset(chars + len, 0, N - len);
+    }
+    std::size_t size() const noexcept { return strnlen(chars, N); }
+    std::string_view view() const noexcept { return std::string_view(chars, size()); }
+    std::string str() const { return std::string(view()); }
+    operator std::string_view() const noexcept { return view(); }
+
+    friend bool operator==(FixedString const& l, std::string_view r) noexcept { return l.view() == r; }
+
+    char chars[N];
+};
+
+template<typename T> struct is_h5_fixed_string : std::false_type {};
+template<std::size_t N> struct is_h5_fixed_string<FixedString<N>> : std::true_type {};
+template<std::size_t N> struct is_h5_fixed_string<std::array<char, N>> : std::true_type {};
+
+// string types are created once and locked, so they live until the library closes
+template<std::size_t N>
+inline hid_t _h5_fixed_string_type_id() {
+    static const hid_t type_id = []() {
+        hid_t id = H5Tcopy(H5T_C_S1);
+        if(id == H5I_INVALID_HID) { throw std::runtime_error("to_h5_type_id,H5Tcopy"); }
+        H5Tset_size(id, N);
+        H5Tset_strpad(id, H5T_STR_NULLPAD);
+        H5Tlock(id);
+        return id;
+    }();
+    return type_id;
+}
+inline hid_t _h5_vlen_string_type_id() {
+    static const hid_t type_id = []() {
+        hid_t id = H5Tcopy(H5T_C_S1);
+        if(id == H5I_INVALID_HID) { throw std::runtime_error("to_h5_type_id,H5Tcopy"); }
+        H5Tset_size(id, H5T_VARIABLE);
+        H5Tset_cset(id, H5T_CSET_UTF8);
+        H5Tlock(id);
+        return id;
+    }();
+    return type_id;
+}
+
 //===============================================================================
 // Type conversions
 //===============================================================================
 template <typename T>
 struct H5TypeMatchFalse { enum { value = false }; };
 template<typename T> inline hid_t to_h5_type_id() { 
-    static_assert(H5TypeMatchFalse<T>::value, "to_h5_type_id,UndefinedType"); 
-    return H5T_NATIVE_CHAR; 
+    if constexpr (is_h5_fixed_string<T>::value) {
+        return _h5_fixed_string_type_id<sizeof(T)>();
+    } else {
+        static_assert(H5TypeMatchFalse<T>::value, "to_h5_type_id,UndefinedType"); 
+        return H5T_NATIVE_CHAR; 
+    }
 }
 template<> inline hid_t to_h5_type_id<bool              >() { return H5T_NATIVE_HBOOL ; } 
 template<> inline hid_t to_h5_type_id<char              >() { return H5T_NATIVE_CHAR  ; } 
@@ -38,21 +115,168 @@ template<> inline hid_t to_h5_type_id<unsigned long long>() { return H5T_NATIVE_
 template<> inline hid_t to_h5_type_id<float             >() { return H5T_NATIVE_FLOAT ; } 
 template<> inline hid_t to_h5_type_id<double            >() { return H5T_NATIVE_DOUBLE; } 
 template<> inline hid_t to_h5_type_id<wcc::NumericTime  >() { return H5T_NATIVE_UINT  ; } 
+template<> inline hid_t to_h5_type_id<std::string       >() { return _h5_vlen_string_type_id(); } 
+
+//===============================================================================
+// Handle management
+//===============================================================================
+// RAII wrapper of an hdf5 id, closed by CloseFn on destruction
+// e.g.
+//   H5Dataset dataset = h5_open_dataset(file_id, "/Data/price");
+//   H5Dread(dataset.id(), ...); // dataset is closed when out of scope, even on exception
+template<herr_t (*CloseFn)(hid_t)>
+class H5Handle {
+public:
+    H5Handle() noexcept : id_(H5I_INVALID_HID) {}
+    explicit H5Handle(hid_t id) noexcept : id_(id) {}
+    H5Handle(H5Handle&& other) noexcept : id_(std::exchange(other.id_, H5I_INVALID_HID)) {}
+    H5Handle(H5Handle const&) = delete;
+    H5Handle& operator=(H5Handle&& other) noexcept {
+        if(this != &other) {
+            reset();
+            id_ = std::exchange(other.id_, H5I_INVALID_HID);
+        }
+        return *this;
+    }
+    H5Handle& operator=(H5Handle const&) = delete;
+    ~H5Handle() noexcept { reset(); }
+
+    hid_t id() const noexcept { return id_; }
+    explicit operator bool() const noexcept { return id_ >= 0; }
+
+    // give up ownership, caller is responsible to close the returned id
+    hid_t release() noexcept { return std::exchange(id_, H5I_INVALID_HID); }
+    void reset() noexcept {
+        if(id_ >= 0) { CloseFn(id_); }
+        id_ = H5I_INVALID_HID;
+    }
+private:
+    hid_t id_;
+};
+using H5Dataset = H5Handle<H5Dclose>;
+using H5Group   = H5Handle<H5Gclose>;
+using H5Space   = H5Handle<H5Sclose>;
+using H5PList   = H5Handle<H5Pclose>;
+
+inline H5Dataset h5_open_dataset(hid_t loc_id, std::string const& path) {
+    H5Dataset dataset(H5Dopen(loc_id, path.c_str(), H5P_DEFAULT));
+    if(!dataset) { throw std::runtime_error("h5_open_dataset,H5Dopen,dataset=\""+path+"\""); }
+    return dataset;
+}
+inline H5Group h5_open_group(hid_t loc_id, std::string const& path) {
+    H5Group group(H5Gopen(loc_id, path.c_str(), H5P_DEFAULT));
+    if(!group) { throw std::runtime_error("h5_open_group,H5Gopen,group=\""+path+"\""); }
+    return group;
+}
+inline H5Space h5_open_space(hid_t dataset_id) {
+    H5Space space(H5Dget_space(dataset_id));
+    if(!space) { throw std::runtime_error("h5_open_space,H5Dget_space"); }
+    return space;
+}
 
 //===============================================================================
 // File management
 //===============================================================================
+// File access tuning applied when H5File opens or creates a file,
+// every default value keeps the hdf5 library default
+struct H5FileOptions {
+    // raw data chunk cache of each dataset opened in the file (H5Pset_cache), library
+    // default is 1M which is too small for wide scans over compressed datasets.
+    // chunk_cache_slots is best a prime about 100 times the number of chunks fitting in
+    // the cache, and chunk_cache_w0 = 1 suits reading each chunk once in order.
+    std::size_t chunk_cache_bytes = 0;
+    std::size_t chunk_cache_slots = 0;
+    double      chunk_cache_w0    = -1.0;
+
+    // initial metadata cache size (H5Pset_mdc_config), raised for files with many objects
+    std::size_t metadata_cache_bytes = 0;
+
+    // load the whole file into memory (H5Pset_fapl_core), for small hot files.
+    // core_backing_store writes the image back to disk on close in 'w' mode.
+    bool        core_driver        = false;
+    std::size_t core_increment     = 64UL<<20;
+    bool        core_backing_store = true;
+
+    // page buffering (H5Pset_page_buffer_size), only works with files created with paged
+    // file space strategy, which H5File does in 'w' mode when page_buffer_bytes is set.
+    // page_buffer_bytes must be at least file_space_page_size.
+    std::size_t page_buffer_bytes    = 0;
+    std::size_t file_space_page_size = 4096;
+
+    // write with the latest file format (H5Pset_libver_bounds), the file can not be read
+    // by hdf5 libraries older than the one writing it
+    bool latest_format = false;
+};
+
+inline H5PList _h5_make_file_access_plist(H5FileOptions const& options) {
+    H5PList fapl(H5Pcreate(H5P_FILE_ACCESS));
+    if(!fapl) { throw std::runtime_error("H5File,H5Pcreate"); }
+
+    if(options.chunk_cache_bytes > 0 || options.chunk_cache_slots > 0 || options.chunk_cache_w0 >= 0) {
+        int mdc_nelmts;
+        std::size_t nslots, nbytes;
+        double w0;
+        if(H5Pget_cache(fapl.id(), &mdc_nelmts, &nslots, &nbytes, &w0) < 0) { throw std::runtime_error("H5File,H5Pget_cache"); }
+        if(options.chunk_cache_bytes > 0) { nbytes = options.chunk_cache_bytes; }
+        if(options.chunk_cache_slots > 0) { nslots = options.chunk_cache_slots; }
+        if(options.chunk_cache_w0 >= 0  ) { w0     = options.chunk_cache_w0   ; }
+        if(H5Pset_cache(fapl.id(), mdc_nelmts, nslots, nbytes, w0) < 0) { throw std::runtime_error("H5File,H5Pset_cache"); }
+    }
+    if(options.metadata_cache_bytes > 0) {
+        H5AC_cache_config_t config;
+        config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+        if(H5Pget_mdc_config(fapl.id(), &config) < 0) { throw std::runtime_error("H5File,H5Pget_mdc_config"); }
+        config.set_initial_size = true;
+        config.initial_size = options.metadata_cache_bytes;
+        config.min_size = std::min(config.min_size, options.metadata_cache_bytes);
+        config.max_size = std::max(config.max_size, options.metadata_cache_bytes);
+        if(H5Pset_mdc_config(fapl.id(), &config) < 0) { throw std::runtime_error("H5File,H5Pset_mdc_config"); }
+    }
+    if(options.core_driver) {
+        if(H5Pset_fapl_core(fapl.id(), options.core_increment, options.core_backing_store) < 0) {
+            throw std::runtime_error("H5File,H5Pset_fapl_core");
+        }
+    }
+    if(options.page_buffer_bytes > 0) {
+        if(H5Pset_page_buffer_size(fapl.id(), options.page_buffer_bytes, 0, 0) < 0) {
+            throw std::runtime_error("H5File,H5Pset_page_buffer_size");
+        }
+    }
+    if(options.latest_format) {
+        if(H5Pset_libver_bounds(fapl.id(), H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) < 0) {
+            throw std::runtime_error("H5File,H5Pset_libver_bounds");
+        }
+    }
+    return fapl;
+}
+
+inline H5PList _h5_make_file_create_plist(H5FileOptions const& options) {
+    H5PList fcpl(H5Pcreate(H5P_FILE_CREATE));
+    if(!fcpl) { throw std::runtime_error("H5File,H5Pcreate"); }
+
+    if(options.page_buffer_bytes > 0) {
+        if(H5Pset_file_space_strategy(fcpl.id(), H5F_FSPACE_STRATEGY_PAGE, false, 1) < 0) {
+            throw std::runtime_error("H5File,H5Pset_file_space_strategy");
+        }
+        if(H5Pset_file_space_page_size(fcpl.id(), options.file_space_page_size) < 0) {
+            throw std::runtime_error("H5File,H5Pset_file_space_page_size");
+        }
+    }
+    return fcpl;
+}
+
 class H5File {
 public:
-    H5File(std::string const& file_name, char mode = 'r')
+    H5File(std::string const& file_name, char mode = 'r', H5FileOptions const& options = {})
         : file_name_(file_name)
     {
+        H5PList fapl = _h5_make_file_access_plist(options);
         switch (mode) {
         case 'r':
-            file_id_ = H5Fopen(file_name_.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+            file_id_ = H5Fopen(file_name_.c_str(), H5F_ACC_RDONLY, fapl.id());
             break;
         case 'w':
-            file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, _h5_make_file_create_plist(options).id(), fapl.id());
             break;
         default:
             throw std::invalid_argument("H5File,InvalidOpenMode");
@@ -62,7 +286,10 @@ public:
             throw std::runtime_error("H5File,OpenFileFailed");
         }
     }
+    H5File(H5File const&) = delete;
+    H5File& operator=(H5File const&) = delete;
     ~H5File() noexcept {
+        close_cached();
         herr_t status = H5Fclose(file_id_);
         if(status < 0) {
             std::cerr << "H5File,ErrorCloseFile,name=" << file_name_ << std::endl; 
@@ -75,9 +302,35 @@ public:
     std::string const& name() const noexcept {
         return file_name_;
     }
+
+    // opened dataset/group id cached by path, the id is owned by H5File and stays valid
+    // until close_cached() or destruction, repeated reads of the same path skip H5Dopen
+    hid_t dataset(std::string const& path) {
+        auto iter = datasets_.find(path);
+        if(iter == datasets_.end()) {
+            iter = datasets_.emplace(path, h5_open_dataset(file_id_, path)).first;
+        }
+        return iter->second.id();
+    }
+    hid_t group(std::string const& path) {
+        auto iter = groups_.find(path);
+        if(iter == groups_.end()) {
+            iter = groups_.emplace(path, h5_open_group(file_id_, path)).first;
+        }
+        return iter->second.id();
+    }
+    std::size_t num_cached() const noexcept {
+        return datasets_.size() + groups_.size();
+    }
+    void close_cached() noexcept {
+        datasets_.clear();
+        groups_.clear();
+    }
 protected:
     std::string file_name_;
     hid_t file_id_;
+    std::unordered_map<std::string, H5Dataset> datasets_;
+    std::unordered_map<std::string, H5Group  > groups_;
 };
 
 
@@ -94,22 +347,26 @@ inline bool h5_has_object(hid_t file_id, std::string const& group) {
         throw std::runtime_error("h5_has_object,H5Lexists"); 
     }
 }
-inline hid_t h5_make_group_if_not_exist(hid_t file_id, std::string const& group) {
-    hid_t group_id;
+// open group, or create it if not exist
+inline H5Group h5_require_group(hid_t file_id, std::string const& group) {
     if(h5_has_object(file_id, group)) {
-        group_id = H5Gopen(file_id, group.c_str(), H5P_DEFAULT);
-        if(group_id < 0) {
+        H5Group group_handle(H5Gopen(file_id, group.c_str(), H5P_DEFAULT));
+        if(!group_handle) {
             throw std::runtime_error("h5_make_group_if_not_exist,H5GOpen"); 
         }
-        return group_id;
+        return group_handle;
     } else {
-        group_id = H5Gcreate(file_id, group.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-        if(group_id == H5I_INVALID_HID) {
+        H5Group group_handle(H5Gcreate(file_id, group.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+        if(!group_handle) {
             throw std::runtime_error("h5_make_group_if_not_exist,H5Gcreate"); 
         }
-        return group_id;
+        return group_handle;
     }
 }
+// same as h5_require_group, but the caller is responsible to H5Gclose the returned id
+inline hid_t h5_make_group_if_not_exist(hid_t file_id, std::string const& group) {
+    return h5_require_group(file_id, group).release();
+}
 
 //===============================================================================
 // scan for objects in group
@@ -150,127 +407,353 @@ inline std::vector<std::string> h5_scan_group_object(hid_t group_id) {
 // given /Stock group id as gid, `scan_path_objects(gid, "AAPL")` returns 
 //   std::vector<std::string>{"Transaction", "Orders"}
 inline std::vector<std::string> h5_scan_path_object(hid_t file_id, std::string const& path) {
-    hid_t group_id = H5Gopen(file_id, path.c_str(), H5P_DEFAULT);
-    if(group_id == H5I_INVALID_HID) {
+    H5Group group(H5Gopen(file_id, path.c_str(), H5P_DEFAULT));
+    if(!group) {
         throw std::runtime_error("h5_scan_path_object,H5Gopen,group=\""+path+"\"");
     }
-    return h5_scan_group_object(group_id);
+    return h5_scan_group_object(group.id());
 }
+inline std::vector<std::string> h5_scan_path_object(H5File& file, std::string const& path) {
+    return h5_scan_group_object(file.group(path));
+}
+
+//===============================================================================
+// Read buffers
+//===============================================================================
+// Allocator adaptor that default-initializes elements constructed without arguments,
+// so resizing a vector using it leaves the new elements untouched instead of zero-filling
+// memory which H5Dread is going to overwrite anyway.
+// e.g.
+//   std::vector<double, DefaultInitAllocator<double>> prices;
+//   h5_read_vector(file_id, "/Data/price", prices); // no memset pass before reading
+template<typename T, typename Alloc = std::allocator<T>>
+class DefaultInitAllocator : public Alloc {
+    using traits = std::allocator_traits<Alloc>;
+public:
+    template<typename U> struct rebind {
+        using other = DefaultInitAllocator<U, typename traits::template rebind_alloc<U>>;
+    };
+
+    using Alloc::Alloc;
+    DefaultInitAllocator() = default;
+
+    template<typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+        ::new(static_cast<void*>(p)) U;
+    }
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        traits::construct(static_cast<Alloc&>(*this), p, std::forward<Args>(args)...);
+    }
+};
 
 //===============================================================================
 // Basic Read Operations
 //===============================================================================
-inline std::vector<std::size_t> h5_query_dataset_dim(hid_t file_id, std::string const& dataset_name) {
-    hid_t dataset_id = H5Dopen(file_id, dataset_name.c_str(), H5P_DEFAULT);
-    if(dataset_id == H5I_INVALID_HID) { throw std::runtime_error("h5_query_dataset_dim,H5Dopen"); }
+// Every read operation accepts either a location id (file or group) with a path relative
+// to it, which opens and closes the dataset on each call, or an H5File with a path, which
+// reuses the dataset handle cached in H5File.
 
-    hid_t dataspace_id = H5Dget_space(dataset_id);
-    if(dataspace_id == H5I_INVALID_HID) { throw std::runtime_error("h5_query_dataset_dim,H5Dget_space"); }
+inline std::vector<std::size_t> _h5_query_dataset_dim(hid_t dataset_id) {
+    H5Space dataspace = h5_open_space(dataset_id);
 
-    int n_dims = H5Sget_simple_extent_ndims(dataspace_id);
+    int n_dims = H5Sget_simple_extent_ndims(dataspace.id());
     std::vector<hsize_t> ext_dims(n_dims, 0);
-    H5Sget_simple_extent_dims(dataspace_id, ext_dims.data(), nullptr);
+    H5Sget_simple_extent_dims(dataspace.id(), ext_dims.data(), nullptr);
 
-    if( H5Dclose(dataset_id) < 0 ) { throw std::runtime_error("h5_query_dataset_dim,H5Dclose"); }
     std::vector<std::size_t> ext_dims_casted(n_dims, 0);
     for(int i = 0; i < n_dims; ++i){
         ext_dims_casted[i] = static_cast<std::size_t>(ext_dims[i]);
     }
     return ext_dims_casted;
 }
+inline std::vector<std::size_t> h5_query_dataset_dim(hid_t file_id, std::string const& dataset_name) {
+    return _h5_query_dataset_dim(h5_open_dataset(file_id, dataset_name).id());
+}
+inline std::vector<std::size_t> h5_query_dataset_dim(H5File& file, std::string const& dataset_name) {
+    return _h5_query_dataset_dim(file.dataset(dataset_name));
+}
 
-template<typename T>
-inline void h5_read_array(hid_t file_id, const std::string& dataset_name, T* data) {
-    hid_t dataset_id = H5Dopen(file_id, dataset_name.c_str(), H5P_DEFAULT);
-    if(dataset_id == H5I_INVALID_HID) { throw std::runtime_error("h5_read_array,H5Dopen"); }
+// variable length strings are read as char* allocated by hdf5, which are copied to data
+// and reclaimed right after
+inline herr_t _h5_read_strings(hid_t dataset_id, hid_t mem_space_id, hid_t file_space_id, std::string* data) {
+    hid_t data_type_id = to_h5_type_id<std::string>();
+    hssize_t n_elements = H5Sget_select_npoints(mem_space_id == H5S_ALL ? file_space_id : mem_space_id);
+    if(n_elements < 0) { return -1; }
+
+    std::vector<char*> buffer(n_elements, nullptr);
+    herr_t status = H5Dread(dataset_id, data_type_id, mem_space_id, file_space_id, H5P_DEFAULT, static_cast<void*>(buffer.data()));
+    if(status < 0) { return status; }
+    for(hssize_t i = 0; i < n_elements; ++i) {
+        data[i] = buffer[i] ? buffer[i] : "";
+    }
+    H5Space reclaim_space(H5Screate_simple(1, std::array<hsize_t, 1>{static_cast<hsize_t>(n_elements)}.data(), nullptr));
+#if H5_VERSION_GE(1,12,0)
+    return H5Treclaim(data_type_id, reclaim_space.id(), H5P_DEFAULT, static_cast<void*>(buffer.data()));
+#else
+    return H5Dvlen_reclaim(data_type_id, reclaim_space.id(), H5P_DEFAULT, static_cast<void*>(buffer.data()));
+#endif
+}
 
+template<typename T>
+inline void _h5_read_array(hid_t dataset_id, T* data) {
     hid_t data_type_id = to_h5_type_id<T>();
-    herr_t status = H5Dread(dataset_id, data_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, static_cast<void*>(data));
+    herr_t status;
+    if constexpr (std::is_same_v<T, std::string>) {
+        status = _h5_read_strings(dataset_id, H5S_ALL, h5_open_space(dataset_id).id(), data);
+    } else {
+        status = H5Dread(dataset_id, data_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, static_cast<void*>(data));
+    }
     if(status < 0) { throw std::runtime_error("h5_read_array,H5Dread"); }
-
-    if( H5Dclose(dataset_id) < 0 ) { throw std::runtime_error("h5_read_array,H5Dclose"); }
+}
+template<typename T>
+inline void h5_read_array(hid_t file_id, const std::string& dataset_name, T* data) {
+    _h5_read_array<T>(h5_open_dataset(file_id, dataset_name).id(), data);
+}
+template<typename T>
+inline void h5_read_array(H5File& file, const std::string& dataset_name, T* data) {
+    _h5_read_array<T>(file.dataset(dataset_name), data);
 }
 
-template<typename Container>
-inline void h5_read_vector(hid_t file_id, const std::string& dataset_name, Container& data) {
-    using value_type = typename Container::value_type;
-    std::vector<value_type> buffer;
+// read rows [row_offset, row_offset + n_rows) along the first dimension of an opened dataset,
+// all other dimensions are read entirely, so data must hold n_rows * (product of other dims)
+template<typename T>
+inline void _h5_read_rows(hid_t dataset_id, hsize_t row_offset, hsize_t n_rows, T* data) {
+    H5Space file_space = h5_open_space(dataset_id);
 
-    std::vector<std::size_t> dims;
-    dims = h5_query_dataset_dim(file_id, dataset_name);
+    int n_dims = H5Sget_simple_extent_ndims(file_space.id());
+    std::vector<hsize_t> start(n_dims, 0);
+    std::vector<hsize_t> count(n_dims, 0);
+    H5Sget_simple_extent_dims(file_space.id(), count.data(), nullptr);
+    start[0] = row_offset;
+    count[0] = n_rows;
 
+    herr_t status = H5Sselect_hyperslab(file_space.id(), H5S_SELECT_SET, start.data(), nullptr, count.data(), nullptr);
+    if(status < 0) { throw std::runtime_error("h5_read_rows,H5Sselect_hyperslab"); }
+
+    H5Space mem_space(H5Screate_simple(n_dims, count.data(), nullptr));
+    if(!mem_space) { throw std::runtime_error("h5_read_rows,H5Screate_simple"); }
+
+    if constexpr (std::is_same_v<T, std::string>) {
+        status = _h5_read_strings(dataset_id, mem_space.id(), file_space.id(), data);
+    } else {
+        status = H5Dread(dataset_id, to_h5_type_id<T>(), mem_space.id(), file_space.id(), H5P_DEFAULT, static_cast<void*>(data));
+    }
+    if(status < 0) { throw std::runtime_error("h5_read_rows,H5Dread"); }
+}
+
+inline std::size_t _h5_count_elements(std::vector<std::size_t> const& dims) {
     if(dims.empty()) { throw std::runtime_error("h5_read_vector,EmptyDataset"); }
 
     std::size_t total_elements = 1;
-    for(int d : dims) { total_elements *= d; }
+    for(std::size_t d : dims) { total_elements *= d; }
 
     if(total_elements == 0) { throw std::runtime_error("h5_read_vector,ExistZeroDim"); }
+    return total_elements;
+}
+
+template<typename Container>
+inline void _h5_read_vector(hid_t dataset_id, Container& data) {
+    using value_type = typename Container::value_type;
 
-    buffer.clear();
-    std::fill_n(std::back_inserter(buffer), total_elements, static_cast<value_type>(0));
-    h5_read_array<value_type>(file_id, dataset_name, buffer.data());
+    std::vector<std::size_t> dims = _h5_query_dataset_dim(dataset_id);
+    std::size_t total_elements = _h5_count_elements(dims);
 
-    // copy buffer to data
-    data.clear();
-    for(value_type const& elem: buffer) {
-        data.push_back(elem);
+    if constexpr (std::ranges::contiguous_range<Container> && requires { data.resize(total_elements); }) {
+        data.resize(total_elements);
+        _h5_read_array<value_type>(dataset_id, std::ranges::data(data));
+    } else if constexpr (std::ranges::contiguous_range<Container> && std::ranges::sized_range<Container>) {
+        if(std::ranges::size(data) != total_elements) { throw std::runtime_error("h5_read_vector,SizeMismatch"); }
+        _h5_read_array<value_type>(dataset_id, std::ranges::data(data));
+    } else {
+        constexpr std::size_t k_block_bytes = 1UL<<20; // 1M read buffer
+        std::size_t row_elements = total_elements / dims[0];
+        std::size_t block_rows = std::max<std::size_t>(1, k_block_bytes / sizeof(value_type) / row_elements);
+        std::unique_ptr<value_type[]> buffer(new value_type[block_rows * row_elements]);
+
+        data.clear();
+        for(std::size_t row = 0; row < dims[0]; row += block_rows) {
+            std::size_t n_rows = std::min(block_rows, dims[0] - row);
+            _h5_read_rows<value_type>(dataset_id, row, n_rows, buffer.get());
+            if constexpr (requires { data.append(std::span<const value_type>()); }) {
+                data.append(std::span<const value_type>(buffer.get(), n_rows * row_elements));  // bulk, e.g. AppendOnlyVec
+            } else {
+                for(std::size_t i = 0; i < n_rows * row_elements; ++i) {
+                    data.push_back(buffer[i]);
+                }
+            }
+        }
     }
 }
-template<typename T>
-inline void h5_read_vector(hid_t file_id, const std::string& dataset_name, std::vector<T>& data) {
-    std::vector<std::size_t> dims;
-    dims = h5_query_dataset_dim(file_id, dataset_name);
 
-    if(dims.empty()) { throw std::runtime_error("h5_read_vector,EmptyDataset"); }
+// Read dataset into container data, replacing its content.
+//
+// - resizable contiguous containers (std::vector, std::string, ...) are resized once and
+//   read in place by H5Dread, no temporary buffer is involved. Note that std::vector<T>
+//   still value-initializes on resize, use std::vector<T, DefaultInitAllocator<T>> to
+//   skip that pass as well.
+// - fixed size contiguous ranges (std::array, std::span, ...) are read in place, and their
+//   size must equal to the number of elements in the dataset.
+// - other containers (std::list, std::deque, AppendOnlyVec, ...) are filled block by block
+//   through a bounded buffer, thus memory peak does not double for large datasets.
+template<typename Container>
+inline void h5_read_vector(hid_t file_id, const std::string& dataset_name, Container& data) {
+    _h5_read_vector(h5_open_dataset(file_id, dataset_name).id(), data);
+}
+template<typename Container>
+inline void h5_read_vector(H5File& file, const std::string& dataset_name, Container& data) {
+    _h5_read_vector(file.dataset(dataset_name), data);
+}
 
-    std::size_t total_elements = 1;
-    for(int d : dims) { total_elements *= d; }
+//===============================================================================
+// Multi-dimensional Operations
+//===============================================================================
+// Row-major (std::layout_right) view over contiguous memory with the interface of std::mdspan,
+// for c++20 code where std::mdspan is not available.
+// h5_read_matrix and h5_write_matrix accept any view providing rank(), extent(r) and
+// data_handle() over row-major memory, such as std::mdspan with std::layout_right.
+// e.g.
+//   std::vector<double> factors(n_rows * n_cols);
+//   h5_read_matrix(h5_file, "/Data/factors", MatrixView<double>(factors.data(), n_rows, n_cols));
+template<typename T, std::size_t Rank = 2>
+class MatrixView {
+public:
+    using element_type = T;
+    using index_type   = std::size_t;
+
+    template<typename... Extents>
+        requires (sizeof...(Extents) == Rank)
+    MatrixView(T* data, Extents... extents) noexcept
+        : data_(data), extents_{static_cast<index_type>(extents)...} {}
+
+    static constexpr std::size_t rank() noexcept { return Rank; }
+    index_type extent(std::size_t r) const noexcept { return extents_[r]; }
+    index_type size() const noexcept {
+        index_type n = 1;
+        for(index_type e : extents_) { n *= e; }
+        return n;
+    }
+    T* data_handle() const noexcept { return data_; }
+
+    template<typename... Indices>
+        requires (sizeof...(Indices) == Rank)
+    T& operator()(Indices... indices) const noexcept {
+        index_type offset = 0, r = 0;
+        ((offset = offset * extents_[r++] + static_cast<index_type>(indices)), ...);
+        return data_[offset];
+    }
+private:
+    T* data_;
+    std::array<index_type, Rank> extents_;
+};
 
-    if(total_elements == 0) { throw std::runtime_error("h5_read_vector,ExistZeroDim"); }
+template<typename View>
+concept H5MdspanLike = requires(View const& view, std::size_t r) {
+    { View::rank() } -> std::convertible_to<std::size_t>;
+    { view.extent(r) } -> std::convertible_to<std::size_t>;
+    { view.data_handle() } -> std::convertible_to<const void*>;
+};
 
-    data.clear();
-    std::fill_n(std::back_inserter(data), total_elements, static_cast<T>(0));
-    h5_read_array<T>(file_id, dataset_name, data.data());
+template<H5MdspanLike View>
+inline std::vector<hsize_t> _h5_view_dims(View const& view, const char* caller) {
+    std::vector<hsize_t> dims(View::rank(), 0);
+    for(std::size_t r = 0; r < View::rank(); ++r) {
+        dims[r] = static_cast<hsize_t>(view.extent(r));
+    }
+    // views with strides, e.g. std::mdspan, must be row-major and exhaustive
+    if constexpr (requires { view.stride(std::size_t(0)); }) {
+        std::size_t expected_stride = 1;
+        for(std::size_t r = View::rank(); r-- > 0; ) {
+            if(static_cast<std::size_t>(view.stride(r)) != expected_stride) {
+                throw std::runtime_error(std::string(caller) + ",NotRowMajor");
+            }
+            expected_stride *= dims[r];
+        }
+    }
+    return dims;
+}
+
+// read a whole dataset into view in place, the extents of view must equal to the dataset dims
+template<H5MdspanLike View>
+inline void _h5_read_matrix(hid_t dataset_id, View const& view) {
+    using value_type = std::remove_cvref_t<decltype(*view.data_handle())>;
+    std::vector<hsize_t> view_dims = _h5_view_dims(view, "h5_read_matrix");
+    std::vector<std::size_t> dims = _h5_query_dataset_dim(dataset_id);
+    if(!std::ranges::equal(dims, view_dims)) { throw std::runtime_error("h5_read_matrix,DimMismatch"); }
+    _h5_read_array<value_type>(dataset_id, view.data_handle());
+}
+template<H5MdspanLike View>
+inline void h5_read_matrix(hid_t file_id, const std::string& dataset_name, View const& view) {
+    _h5_read_matrix(h5_open_dataset(file_id, dataset_name).id(), view);
+}
+template<H5MdspanLike View>
+inline void h5_read_matrix(H5File& file, const std::string& dataset_name, View const& view) {
+    _h5_read_matrix(file.dataset(dataset_name), view);
 }
 
 //===============================================================================
 // Basic Write Operations
 //===============================================================================
+// create dataset of given dims and write data in row-major order,
+// datasets of at least 8k elements are chunked by rows of about 8k elements and compressed if enable_zip
 template<typename T>
-inline void h5_write_array(hid_t file_id, const std::string& dataset_name, const T* data, std::size_t len, bool enable_zip = true) {
+inline void _h5_write_dataset(hid_t file_id, const std::string& dataset_name, const T* data, std::vector<hsize_t> const& dims, bool enable_zip) {
     constexpr std::size_t k_chunk_size = 8UL<<10; // 8k chunk size
-    constexpr std::size_t k_rank = 1;
     constexpr int k_compress_level = 3;
-    hsize_t dims[k_rank];
-    hsize_t chunk_dims[k_rank];
-    dims[0] = len;
-    chunk_dims[0] = k_chunk_size;
+    int rank = static_cast<int>(dims.size());
+    if(rank == 0) { throw std::runtime_error("h5_write_array,EmptyDims"); }
+
+    std::size_t len = 1;
+    for(hsize_t d : dims) { len *= d; }
+    std::size_t row_elements = dims[0] == 0 ? 1 : len / dims[0];
 
-    hid_t dataspace_id = H5Screate_simple(k_rank, dims, nullptr);
-    if(dataspace_id == H5I_INVALID_HID) { throw std::runtime_error("h5_write_array,H5Screate_simple"); }
+    std::vector<hsize_t> chunk_dims(dims);
+    chunk_dims[0] = std::max<std::size_t>(1, k_chunk_size / std::max<std::size_t>(1, row_elements));
+
+    H5Space dataspace(H5Screate_simple(rank, dims.data(), nullptr));
+    if(!dataspace) { throw std::runtime_error("h5_write_array,H5Screate_simple"); }
 
     hid_t data_type_id = to_h5_type_id<T>();
 
-    hid_t dataset_id;
+    H5PList plist(H5Pcreate(H5P_DATASET_CREATE));
+    if(!plist) { throw std::runtime_error("h5_write_array,H5Pcreate"); }
     if(enable_zip && len >= k_chunk_size) {
-        hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
-        H5Pset_chunk(plist_id, k_rank, chunk_dims);
-        H5Pset_deflate(plist_id, k_compress_level);
-        dataset_id = H5Dcreate(file_id, dataset_name.c_str(), data_type_id, dataspace_id, 
-                               H5P_DEFAULT, plist_id, H5P_DEFAULT);
-    } else {
-        dataset_id = H5Dcreate(file_id, dataset_name.c_str(), data_type_id, dataspace_id, 
-                               H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Pset_chunk(plist.id(), rank, chunk_dims.data());
+        H5Pset_deflate(plist.id(), k_compress_level);
     }
-    if(dataset_id == H5I_INVALID_HID) { 
+    H5Dataset dataset(H5Dcreate(file_id, dataset_name.c_str(), data_type_id, dataspace.id(), 
+                                H5P_DEFAULT, plist.id(), H5P_DEFAULT));
+    if(!dataset) { 
         throw std::runtime_error("h5_write_array,H5Dcreate"); 
     }
 
-    herr_t status = H5Dwrite(dataset_id, data_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, static_cast<const void*>(data));
+    herr_t status;
+    if constexpr (std::is_same_v<T, std::string>) {
+        // variable length strings are written from their char pointers
+        std::vector<const char*> buffer(len);
+        for(std::size_t i = 0; i < len; ++i) {
+            buffer[i] = data[i].c_str();
+        }
+        status = H5Dwrite(dataset.id(), data_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, static_cast<const void*>(buffer.data()));
+    } else {
+        status = H5Dwrite(dataset.id(), data_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, static_cast<const void*>(data));
+    }
     if(status < 0) { throw std::runtime_error("h5_write_array,H5Dwrite"); }
-
-    if( H5Sclose(dataspace_id) < 0 ) { throw std::runtime_error("h5_write_array,H5Sclose"); }
-    if( H5Dclose(dataset_id) < 0 ) { throw std::runtime_error("h5_write_array,H5Dclose"); }
+}
+template<typename T>
+inline void h5_write_array(hid_t file_id, const std::string& dataset_name, const T* data, std::size_t len, bool enable_zip = true) {
+    _h5_write_dataset<T>(file_id, dataset_name, data, {static_cast<hsize_t>(len)}, enable_zip);
+}
+// write row-major rows x cols matrix as a 2-D dataset
+template<typename T>
+inline void h5_write_matrix(hid_t file_id, const std::string& dataset_name, const T* data, std::size_t rows, std::size_t cols, bool enable_zip = true) {
+    _h5_write_dataset<T>(file_id, dataset_name, data, {static_cast<hsize_t>(rows), static_cast<hsize_t>(cols)}, enable_zip);
+}
+// write view as a dataset of the same rank and extents
+template<H5MdspanLike View>
+inline void h5_write_matrix(hid_t file_id, const std::string& dataset_name, View const& view, bool enable_zip = true) {
+    using value_type = std::remove_cvref_t<decltype(*view.data_handle())>;
+    _h5_write_dataset<value_type>(file_id, dataset_name, view.data_handle(), _h5_view_dims(view, "h5_write_matrix"), enable_zip);
 }
 template<typename Container>
 inline void h5_write_vector(hid_t file_id, const std::string& dataset_name, Container const& data, bool enable_zip = true) {
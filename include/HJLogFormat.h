@@ -19,6 +19,12 @@
  * The file also provides the VAR() macro, which is a helper macro for formatting variables
  * in the log messages.
  *
+ * With "event_log: true" in config_log, each line is also written as a typed binary record
+ * (see EventLog.h), with field names taken from the format strings at compile time.
+ *
+ * Levels below WCC_LOG_ACTIVE_LEVEL (0 trace ... 5 critical, default 0) expand to an empty
+ * block at compile time. Above it, the logger level is checked before any argument is evaluated.
+ *
  * These macros use the Boost Preprocessor library for variadic macro processing and string
  * manipulation.
  *
@@ -29,6 +35,7 @@
 #pragma once
 
 #include "LogConfig.h"
+#include "LogLimit.h"
 #include <boost/preprocessor/stringize.hpp>
 #include <boost/preprocessor/variadic.hpp>
 #include <boost/preprocessor/seq/seq.hpp>
@@ -36,9 +43,17 @@
 #include <boost/preprocessor/seq/enum.hpp>
 #include <boost/preprocessor/tuple/elem.hpp>
 #include <boost/preprocessor/control/if.hpp>
-#include <boost/preprocessor/seq/fold_left.hpp>
+#include <boost/preprocessor/seq/for_each_i.hpp>
 #include <boost/preprocessor/facilities/empty.hpp>
 #include <boost/preprocessor/comparison/equal.hpp>
+#include <boost/preprocessor/comparison/greater_equal.hpp>
+#include <boost/preprocessor/control/expr_if.hpp>
+#include <boost/preprocessor/cat.hpp>
+
+// Minimum level compiled in; same numbering as SPDLOG_LEVEL_TRACE ... SPDLOG_LEVEL_CRITICAL
+#ifndef WCC_LOG_ACTIVE_LEVEL
+#define WCC_LOG_ACTIVE_LEVEL 0
+#endif
 
 #ifndef FUN_EVT_FORMAT_STR
 #define FUN_EVT_FORMAT_STR "[{}] [{}]"   // [{:16.16s}] [{:12.12s}] "
@@ -52,12 +67,16 @@
 #define VAR_FROM_TUPLE(s,i,tuple) \
     BOOST_PP_IF(BOOST_PP_EQUAL(BOOST_PP_TUPLE_SIZE(tuple),2), BOOST_PP_TUPLE_ELEM(1,tuple), BOOST_PP_TUPLE_ELEM(0,tuple))
 
-// Macro helper to juxtapose two strings with a comma separator
-#define JUXTAPOSE(s, state, x) BOOST_PP_IF(BOOST_PP_EQUAL(s,1), x, state "," x)
+// Macro helper to juxtapose strings with a comma separator (none before the first one)
+#define JUXTAPOSE(r, data, i, x) BOOST_PP_EXPR_IF(i, ",") x
 
 // Macro helper to collect format strings from a variadic sequence
 #define COLLECT_FORMAT_STR(...) \
-      BOOST_PP_SEQ_FOLD_LEFT(JUXTAPOSE, 0,BOOST_PP_SEQ_TRANSFORM(FORMAT_STR_FROM_TUPLE, 0, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__)))
+      BOOST_PP_SEQ_FOR_EACH_I(JUXTAPOSE, 0, BOOST_PP_SEQ_TRANSFORM(FORMAT_STR_FROM_TUPLE, 0, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__)))
+
+// Macro helper to list the format strings, one per pair (for the event field names)
+#define COLLECT_FIELD_FMTS(...) \
+      BOOST_PP_SEQ_ENUM(BOOST_PP_SEQ_TRANSFORM(FORMAT_STR_FROM_TUPLE, 0, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__)))
 
 // Macro helper to collect variables from a variadic sequence
 #define COLLECT_VAR(...) \
@@ -75,17 +94,44 @@
 #define HJ_HAS_ID(is_method) BOOST_PP_IF(is_method, wcc::internal::has_trader_id<decltype(this)>::value, false)
 #define HJ_ID(is_method)     BOOST_PP_IF(is_method, wcc::internal::trader_id(this), '-') // the '-' is used when there is no id
 
+// Level names used by the macros mapped to spdlog::level numbers
+#define HJ_LEVEL_trace    0
+#define HJ_LEVEL_debug    1
+#define HJ_LEVEL_info     2
+#define HJ_LEVEL_warn     3
+#define HJ_LEVEL_error    4
+#define HJ_LEVEL_critical 5
+#define HJ_LEVEL(level)   BOOST_PP_CAT(HJ_LEVEL_, level)
+
+// Compile-time filter: the macro body for enabled levels, an empty block otherwise
+#define HJ_IF_ACTIVE(level, body) \
+    BOOST_PP_IF(BOOST_PP_GREATER_EQUAL(HJ_LEVEL(level), WCC_LOG_ACTIVE_LEVEL), body, HJ_INACTIVE)
+#define HJ_INACTIVE(...) {}
+
+#define HJ_SPDLOG_LEVEL(lvl) static_cast<spdlog::level::level_enum>(HJ_LEVEL(lvl))
+
+// Runtime filter evaluated before any of the logged arguments
+#define HJ_ENABLED(is_method, lvl) HJ_THIS(is_method)log_enabled(HJ_SPDLOG_LEVEL(lvl))
+
+// Call site description for the structured event record (see EventLog.h): field names are
+// taken from the format strings at compile time
+#define HJ_FIELDS(...) \
+    constexpr auto hj_fields = ::wcc::internal::event_field_names(__VA_OPT__(COLLECT_FIELD_FMTS(__VA_ARGS__)));
+#define HJ_SITE(has_id, event) ::wcc::internal::event_site<has_id>(fun_name, event, hj_fields)
+
 /**
  * HJ_LOG macro for formatted output with a given level, event, and format-value pairs.
  * It uses the logger attached to the current class (is_method == 1) or the "main" logger (is_method == 0).
  */
-#define HJ_LOG(is_method, level, event, ...) {                                                            \
+#define HJ_LOG(is_method, level, ...) HJ_IF_ACTIVE(level, HJ_LOG_IMPL)(is_method, level, __VA_ARGS__)
+#define HJ_LOG_IMPL(is_method, level, event, ...) { if (HJ_ENABLED(is_method, level)) [[unlikely]] {      \
     constexpr auto fun_name = ::wcc::get_source_function_name(std::source_location::current());           \
-    HJ_THIS(is_method)log_##level(FUN_EVT_FORMAT_STR "{{"                                                 \
-        BOOST_PP_IF(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), COLLECT_FORMAT_STR, BOOST_PP_EMPTY)(__VA_ARGS__) \
+    HJ_FIELDS(__VA_ARGS__)                                                                                \
+    HJ_THIS(is_method)log_event(HJ_SPDLOG_LEVEL(level), HJ_SITE(false, event), FUN_EVT_FORMAT_STR "{{"    \
+        __VA_OPT__(COLLECT_FORMAT_STR(__VA_ARGS__))                                                       \
         "}}", fun_name, event                                                                             \
-        BOOST_PP_IF(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), COLLECT_VAR, BOOST_PP_EMPTY)(__VA_ARGS__));      \
-}
+        __VA_OPT__(COLLECT_VAR(__VA_ARGS__)));                                                            \
+}}
 
 /**
  * HJ_TLOG macro for formatted output with a given level, event, and format-value pairs.
@@ -93,20 +139,22 @@
  * It also includes trader id information as [tid] if the current class has a trader_id() method, or [-] if not.
  * Note that is_method == 0 means no trader_id() is available (since there's no class/object).
  */
-#define HJ_TLOG(is_method, level, event, ...) {                                                           \
+#define HJ_TLOG(is_method, level, ...) HJ_IF_ACTIVE(level, HJ_TLOG_IMPL)(is_method, level, __VA_ARGS__)
+#define HJ_TLOG_IMPL(is_method, level, event, ...) { if (HJ_ENABLED(is_method, level)) [[unlikely]] {     \
     constexpr auto fun_name = ::wcc::get_source_function_name(std::source_location::current());           \
+    HJ_FIELDS(__VA_ARGS__)                                                                                \
     if constexpr (HJ_HAS_ID(is_method)) {                                                                 \
-        HJ_THIS(is_method)log_##level(FUN_EVT_FORMAT_STR "[{}] {{"                                        \
-        BOOST_PP_IF(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), COLLECT_FORMAT_STR, BOOST_PP_EMPTY)(__VA_ARGS__) \
+        HJ_THIS(is_method)log_event(HJ_SPDLOG_LEVEL(level), HJ_SITE(true, event), FUN_EVT_FORMAT_STR "[{}] {{" \
+        __VA_OPT__(COLLECT_FORMAT_STR(__VA_ARGS__))                                                       \
         "}}", fun_name, event, HJ_ID(is_method)                                                           \
-        BOOST_PP_IF(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), COLLECT_VAR, BOOST_PP_EMPTY)(__VA_ARGS__));      \
+        __VA_OPT__(COLLECT_VAR(__VA_ARGS__)));                                                            \
     } else {                                                                                              \
-        HJ_THIS(is_method)log_##level(FUN_EVT_FORMAT_STR "[-] {{"                                         \
-        BOOST_PP_IF(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), COLLECT_FORMAT_STR, BOOST_PP_EMPTY)(__VA_ARGS__) \
+        HJ_THIS(is_method)log_event(HJ_SPDLOG_LEVEL(level), HJ_SITE(false, event), FUN_EVT_FORMAT_STR "[-] {{" \
+        __VA_OPT__(COLLECT_FORMAT_STR(__VA_ARGS__))                                                       \
         "}}", fun_name, event                                                                             \
-        BOOST_PP_IF(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), COLLECT_VAR, BOOST_PP_EMPTY)(__VA_ARGS__));      \
+        __VA_OPT__(COLLECT_VAR(__VA_ARGS__)));                                                            \
     }                                                                                                     \
-}
+}}
 
 /**
  * HJ_LOG_ID macro for formatted output with a given level, event, and format-value pairs.
@@ -115,14 +163,48 @@
  *
  * Used in cases where the id cannot be obtained through the this->trader_id() call but does exist and needs to be output.
  */
-#define HJ_LOG_ID(is_method, level, event, trader_id, ...) {                                              \
+#define HJ_LOG_ID(is_method, level, ...) HJ_IF_ACTIVE(level, HJ_LOG_ID_IMPL)(is_method, level, __VA_ARGS__)
+#define HJ_LOG_ID_IMPL(is_method, level, event, trader_id, ...) { if (HJ_ENABLED(is_method, level)) [[unlikely]] { \
     constexpr auto fun_name = ::wcc::get_source_function_name(std::source_location::current());           \
-    HJ_THIS(is_method)log_##level(FUN_EVT_FORMAT_STR "[{}] {{"                                            \
-        BOOST_PP_IF(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), COLLECT_FORMAT_STR, BOOST_PP_EMPTY)(__VA_ARGS__) \
+    HJ_FIELDS(__VA_ARGS__)                                                                                \
+    HJ_THIS(is_method)log_event(HJ_SPDLOG_LEVEL(level), HJ_SITE(true, event), FUN_EVT_FORMAT_STR "[{}] {{" \
+        __VA_OPT__(COLLECT_FORMAT_STR(__VA_ARGS__))                                                       \
         "}}", fun_name, event, trader_id                                                                  \
-        BOOST_PP_IF(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), COLLECT_VAR, BOOST_PP_EMPTY)(__VA_ARGS__));      \
+        __VA_OPT__(COLLECT_VAR(__VA_ARGS__)));                                                            \
+}}
+
+/**
+ * HJ_LOG_LIMITED: HJ_LOG guarded by a per call site, per thread limiter (see LogLimit.h).
+ * Written lines carry an extra "suppressed:N" field, the number of lines dropped before them.
+ */
+#define HJ_LOG_LIMITED(limiter, is_method, level, ...)                                                   \
+    HJ_IF_ACTIVE(level, HJ_LOG_LIMITED_IMPL)(limiter, is_method, level, __VA_ARGS__)
+#define HJ_LOG_LIMITED_IMPL(limiter, is_method, level, event, ...) {                                     \
+    if (HJ_ENABLED(is_method, level)) [[unlikely]] {                                                      \
+        static thread_local auto hj_limiter = limiter;                                                    \
+        if (uint64_t hj_suppressed; hj_limiter.admit(hj_suppressed))                                      \
+            HJ_LOG_IMPL(is_method, level, event, __VA_ARGS__ __VA_OPT__(,) ("suppressed:{}", hj_suppressed)) \
+    }                                                                                                     \
 }
 
+/**
+ * HJ_LOG_DEDUP: HJ_LOG dropping lines whose values repeat the last written line of this call
+ * site within window. The values are evaluated once, hashed and then logged.
+ */
+#define HJ_LOG_DEDUP(window, is_method, level, ...)                                                      \
+    HJ_IF_ACTIVE(level, HJ_LOG_DEDUP_IMPL)(window, is_method, level, __VA_ARGS__)
+#define HJ_LOG_DEDUP_IMPL(window, is_method, level, event, ...) { if (HJ_ENABLED(is_method, level)) [[unlikely]] { \
+    constexpr auto fun_name = ::wcc::get_source_function_name(std::source_location::current());           \
+    HJ_FIELDS(__VA_ARGS__ __VA_OPT__(,) ("suppressed:{}", 0))                                             \
+    static thread_local ::wcc::LogDedup hj_limiter{window};                                               \
+    ::wcc::internal::invoke_with([&](auto const&... hj_values) {                                          \
+        if (uint64_t hj_suppressed; hj_limiter.admit(::wcc::internal::hash_values(hj_values...), hj_suppressed)) \
+            HJ_THIS(is_method)log_event(HJ_SPDLOG_LEVEL(level), HJ_SITE(false, event), FUN_EVT_FORMAT_STR "{{" \
+                COLLECT_FORMAT_STR(__VA_ARGS__ __VA_OPT__(,) ("suppressed:{}", 0))                        \
+                "}}", fun_name, event, hj_values..., hj_suppressed);                                      \
+    } __VA_OPT__(COLLECT_VAR(__VA_ARGS__)));                                                              \
+}}
+
 // Macro helpers for VAR() macro
 #define VAR_1(a)      (BOOST_PP_STRINGIZE(a)":{}", a)
 #define VAR_2(fmt, a) (BOOST_PP_STRINGIZE(a)":{:" fmt "}", a)
@@ -134,3 +216,11 @@
 #define LOG(...)      HJ_LOG(0, __VA_ARGS__)
 #define ID_MLOG(...)  HJ_TLOG(1, __VA_ARGS__)
 #define ID_LOG(...)   HJ_TLOG(0, __VA_ARGS__)
+
+// Limited variants, e.g. MLOG_RATE(100, warn, "book", VAR(px)); state is per call site and thread
+#define MLOG_EVERY_N(n, ...)       HJ_LOG_LIMITED(::wcc::LogEveryN(n), 1, __VA_ARGS__)
+#define LOG_EVERY_N(n, ...)        HJ_LOG_LIMITED(::wcc::LogEveryN(n), 0, __VA_ARGS__)
+#define MLOG_RATE(per_sec, ...)    HJ_LOG_LIMITED(::wcc::LogRateLimit(per_sec), 1, __VA_ARGS__)
+#define LOG_RATE(per_sec, ...)     HJ_LOG_LIMITED(::wcc::LogRateLimit(per_sec), 0, __VA_ARGS__)
+#define MLOG_DEDUP(window, ...)    HJ_LOG_DEDUP(window, 1, __VA_ARGS__)
+#define LOG_DEDUP(window, ...)     HJ_LOG_DEDUP(window, 0, __VA_ARGS__)
@@ -1,26 +1,102 @@
 #pragma once
 
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>  // for getpid()
 #include <ctime>
 #include <filesystem>
 #include <regex>
+#include <iterator>
 #include <sstream>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 #include <charconv> // from_chars
 #include <source_location>
+#include <condition_variable>
+#include <mutex>
 #include <fmt/format.h>
+#include <fmt/ranges.h>  // fmt::join
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/stdout_sinks.h>
 #include <spdlog/sinks/ostream_sink.h>
 #include <spdlog/spdlog.h>
+#include <spdlog/async_logger.h>
+#include <spdlog/details/thread_pool.h>
 #include <yaml-cpp/yaml.h>
 #include <boost/container/flat_map.hpp>
+#include "DeferredLog.h"
+#include "EventLog.h"
+#include "LogFileSinks.h"
+#include "ShmLogRing.h"
+#include "LogWatcher.h"
 
 namespace wcc {
 
 namespace internal {
 
+// Sink used by log_flush to wait until the async workers have written everything queued before it.
+// Each barrier message carries its round; a worker taking a barrier of the current round waits
+// until all workers hold one, so none is still writing an earlier message. With async_overflow
+// drop_oldest a barrier can be discarded from the queue: wait_async then abandons the round,
+// which releases the waiting workers, and starts a new one. Barriers of abandoned rounds are ignored.
+class flush_barrier_sink final : public spdlog::sinks::sink {
+public:
+    explicit flush_barrier_sink(size_t n_threads) : n_threads_(n_threads) {}
+
+    void log(spdlog::details::log_msg const& msg) override {
+        uint64_t round = 0;
+        std::from_chars(msg.payload.data(), msg.payload.data() + msg.payload.size(), round);
+        std::unique_lock lock(mutex_);
+        if (round != round_) return;
+        if (++arrived_ == n_threads_) cv_.notify_all();
+        cv_.wait(lock, [&] { return round != round_ || arrived_ == n_threads_; });
+    }
+    void flush() override {}
+    void set_pattern(std::string const&) override {}
+    void set_formatter(std::unique_ptr<spdlog::formatter>) override {}
+
+    uint64_t start_round() {
+        std::lock_guard lock(mutex_);
+        arrived_ = 0;
+        return ++round_;
+    }
+
+    // Returns false if the current round is not complete within timeout
+    bool wait_round(std::chrono::milliseconds timeout) {
+        std::unique_lock lock(mutex_);
+        return cv_.wait_for(lock, timeout, [&] { return arrived_ == n_threads_; });
+    }
+
+    // Release the workers waiting in the current round
+    void abandon_round() {
+        std::lock_guard lock(mutex_);
+        ++round_;
+        cv_.notify_all();
+    }
+
+private:
+    size_t n_threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t round_ = 0;
+    size_t arrived_ = 0;
+};
+
+struct async_state {
+    std::shared_ptr<spdlog::details::thread_pool> pool;
+    size_t n_threads;
+    std::shared_ptr<flush_barrier_sink> barrier_sink;
+    std::shared_ptr<spdlog::async_logger> barrier;
+    std::mutex mutex;  // one flush barrier at a time
+};
+
+// Level a timed "level" command restores; id tells the latest scheduled restore from older ones
+struct level_restore {
+    spdlog::level::level_enum level;
+    uint64_t id;
+};
+
 struct impl {  // make impl a struct so that static members can be inlined and linked as one unit
     struct string_less : std::less<std::string> {
         using is_transparent = void;
@@ -28,8 +104,20 @@ struct impl {  // make impl a struct so that static members can be inlined and l
     };
 
     inline static std::string s_logger_config_file = "config node";
-    inline static boost::container::flat_map<std::string, spdlog::logger, string_less> s_loggers;
+    inline static boost::container::flat_map<std::string, std::shared_ptr<spdlog::logger>, string_less> s_loggers;
     inline static std::ostringstream s_oss;
+    inline static spdlog::logger* s_main = nullptr;  // "main" resolved once by config_log for the free log_* functions
+    inline static std::unique_ptr<EventLogWriter> s_event_log;  // set by config_log for "event_log: true"
+    // set by config_log for "async: true"; the pool drains its queue into the sinks on destruction
+    inline static std::unique_ptr<async_state> s_async;
+    // set by config_log for "backend: deferred"; declared after the loggers so it drains before they go away
+    inline static std::unique_ptr<DeferredLogBackend> s_deferred;
+    inline static std::mutex s_reload_mutex;  // serializes level changes, never taken by log calls
+    // pending restores of timed level commands, one per logger; guarded by s_reload_mutex
+    inline static boost::container::flat_map<std::string, level_restore, string_less> s_restores;
+    inline static uint64_t s_restore_id = 0;
+    // set by config_log for "watch_config" / "control_fifo"; declared last so it stops first
+    inline static std::unique_ptr<LogConfigWatcher> s_watcher;
 };  // struct impl
 
 // T must be a pointer (since it is used as has_id<this> for now)
@@ -41,13 +129,66 @@ auto trader_id(const T* t) {
     else return 0; // doesn't matter what returns (both type and value) here since it will be discarded by compiler
 }
 
+inline void set_thread_affinity(std::vector<int> const& cpus) {
+    if (cpus.empty()) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    if (int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); rc != 0)
+        fmt::print(stderr, "set_thread_affinity,Failed,rc={},cpus={}\n", rc, fmt::join(cpus, ","));
+}
+
+// Levels from default_level, set_error_loggers and set_debug_loggers; all names are checked
+// before any level is set. Levels are atomics, so log calls are never blocked by this.
+inline void apply_levels(YAML::Node const& cfg) {
+    auto lvl_str = cfg["default_level"].as<std::string>();
+    auto lvl = spdlog::level::from_str(lvl_str);
+    if (lvl == spdlog::level::off)
+        throw std::runtime_error("unknown log level");
+    std::vector<spdlog::level::level_enum> levels(impl::s_loggers.size(), lvl);
+
+    auto set_list = [&levels](YAML::Node const& cfg_loggers, spdlog::level::level_enum list_lvl) {
+        if (!cfg_loggers || cfg_loggers.IsNull()) return;
+        for (auto const& logger_name : cfg_loggers.as<std::vector<std::string>>()) {
+            auto iter = impl::s_loggers.find(logger_name);
+            if (iter == impl::s_loggers.end())
+                throw std::runtime_error(fmt::format("MissingLogger:{}", logger_name));
+            levels[iter - impl::s_loggers.begin()] = list_lvl;
+        }
+    };
+    set_list(cfg["set_error_loggers"], spdlog::level::err);   // Disable List
+    set_list(cfg["set_debug_loggers"], spdlog::level::debug); // Enable List
+
+    std::lock_guard lock(impl::s_reload_mutex);
+    impl::s_restores.clear();  // the config is the reference again
+    size_t i = 0;
+    for (auto const& [_, logger] : impl::s_loggers) logger->set_level(levels[i++]);
+}
+
+// Wait until every async worker has processed the messages queued so far
+inline void wait_async() {
+    auto& state = *impl::s_async;
+    std::lock_guard lock(state.mutex);
+    for (;;) {
+        size_t overruns = state.pool->overrun_counter();
+        uint64_t round = state.barrier_sink->start_round();
+        for (size_t i = 0; i < state.n_threads; ++i) state.barrier->info("{}", round);  // one barrier per worker
+        // keep waiting unless messages were dropped since, as one of them may be a barrier
+        while (!state.barrier_sink->wait_round(std::chrono::milliseconds(10))) {
+            if (state.pool->overrun_counter() != overruns) break;
+        }
+        if (state.barrier_sink->wait_round(std::chrono::milliseconds(0))) return;
+        state.barrier_sink->abandon_round();
+    }
+}
+
 } // namespace internal
 
 
 inline spdlog::logger* get_logger(std::string_view logger_name) {
     auto iter = internal::impl::s_loggers.find(logger_name);
     if (iter != internal::impl::s_loggers.end()) [[likely]]
-        return &(iter->second);
+        return iter->second.get();
 
     fmt::print(stderr, "get_logger,MissingLogger,logger={},LogConfig={}\n",
                logger_name, internal::impl::s_logger_config_file);
@@ -74,6 +215,73 @@ inline auto get_logger_str() {
     return str;
 }
 
+namespace internal {
+
+inline spdlog::level::level_enum level_from_str(std::string_view lvl_str) {
+    auto lvl = spdlog::level::from_str(std::string(lvl_str));
+    if (lvl == spdlog::level::off && lvl_str != "off")
+        throw std::runtime_error(fmt::format("unknown log level,{}", lvl_str));
+    return lvl;
+}
+
+// Control commands, as read by the config watcher:
+//   reload                               re-read the levels from the config file, dropping pending restores
+//   level <logger|*> <level> [duration]  set a level; with a duration ("300s") the level the logger had
+//                                        before its first pending timed command is restored when the
+//                                        latest one expires
+//   restore <logger> <id>                scheduled by the above, ignored unless id is still the latest
+inline void run_log_command(std::string_view command) {
+    std::istringstream iss{std::string(command)};
+    std::vector<std::string> words{std::istream_iterator<std::string>(iss), std::istream_iterator<std::string>()};
+
+    if (words.size() == 1 && words[0] == "reload") {
+        if (impl::s_logger_config_file == "config node")
+            throw std::runtime_error("reload needs config_log(config_file)");
+        apply_levels(YAML::LoadFile(impl::s_logger_config_file));
+        fmt::print("log levels reloaded from {}\n", impl::s_logger_config_file);
+        return;
+    }
+
+    if ((words.size() == 3 || words.size() == 4) && words[0] == "level") {
+        auto lvl = level_from_str(words[2]);
+        auto restore_after = words.size() == 4 ? dur_from_chars(words[3]) : std::chrono::system_clock::duration::zero();
+        if (restore_after.count() > 0 && !impl::s_watcher)
+            throw std::runtime_error("timed level needs watch_config or control_fifo");
+        std::vector<spdlog::logger*> loggers;
+        if (words[1] == "*") {
+            for (auto const& [_, logger] : impl::s_loggers) loggers.push_back(logger.get());
+        } else {
+            loggers.push_back(get_logger(words[1]));
+        }
+
+        std::lock_guard lock(impl::s_reload_mutex);
+        for (auto* logger : loggers) {
+            if (restore_after.count() > 0) {
+                auto [iter, _] = impl::s_restores.try_emplace(logger->name(), level_restore{logger->level(), 0});
+                iter->second.id = ++impl::s_restore_id;
+                impl::s_watcher->schedule(restore_after, fmt::format("restore {} {}", logger->name(), iter->second.id));
+            } else {
+                impl::s_restores.erase(logger->name());  // set for good
+            }
+            logger->set_level(lvl);
+        }
+        return;
+    }
+
+    if (words.size() == 3 && words[0] == "restore") {
+        std::lock_guard lock(impl::s_reload_mutex);
+        auto iter = impl::s_restores.find(words[1]);
+        if (iter == impl::s_restores.end() || std::to_string(iter->second.id) != words[2]) return;
+        get_logger(iter->first)->set_level(iter->second.level);
+        impl::s_restores.erase(iter);
+        return;
+    }
+
+    throw std::runtime_error(fmt::format("unknown log command,{}", command));
+}
+
+} // namespace internal
+
 inline void config_log(YAML::Node const& cfg) {
     static bool once = false;
 
@@ -90,75 +298,196 @@ inline void config_log(YAML::Node const& cfg) {
 
     std::regex today_regex("\\$\\{today\\}");
 
+    // log file path without the .log extension
+    auto log_file_base = [&] {
+        std::string default_log_dir = cfg["default_log_dir"].as<std::string>();
+        default_log_dir = std::regex_replace(default_log_dir, today_regex, today_str);
+        std::string default_log_prefix = cfg["default_log_prefix"].as<std::string>();
+        default_log_prefix = std::regex_replace(default_log_prefix, today_regex, today_str);
+        std::filesystem::create_directories(default_log_dir);  // create log_dir if not exist
+        return default_log_dir + '/' + default_log_prefix + ".pid." + std::to_string(getpid());
+    };
+
+    // rotating_file / daily_file settings: closed segments beyond max_files are removed,
+    // the others are compressed in the background when compression is gzip or zstd
+    size_t max_file_size = cfg["max_file_size"] ? cfg["max_file_size"].as<size_t>() : 100 << 20;
+    size_t max_files = cfg["max_files"] ? cfg["max_files"].as<size_t>() : 0;
+    auto compression = cfg["compression"] ? log_compression_from_str(cfg["compression"].as<std::string>())
+                                          : LogCompression::none;
+    std::shared_ptr<SegmentCompressor> compressor;
+    if (compression != LogCompression::none) compressor = std::make_shared<SegmentCompressor>(compression);
+
     std::vector<spdlog::sink_ptr> sinks;
     auto sink_table = cfg["sinks"].as<std::vector<std::string>>();
     for (const auto &sink : sink_table) {
         if (sink == "stdout")
             sinks.push_back(std::make_shared<spdlog::sinks::stdout_sink_mt>());
         if (sink == "basic_file") {
-            std::string default_log_dir = cfg["default_log_dir"].as<std::string>();
-            default_log_dir = std::regex_replace(default_log_dir, today_regex, today_str);
-            std::string default_log_prefix = cfg["default_log_prefix"].as<std::string>();
-            default_log_prefix = std::regex_replace(default_log_prefix, today_regex, today_str);
-            std::string log_file = default_log_dir + '/' + default_log_prefix + ".pid." + std::to_string(getpid()) + ".log";
-            std::filesystem::create_directories(default_log_dir);  // create log_dir if not exist
-            sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_file));
+            sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_file_base() + ".log"));
+        }
+        if (sink == "rotating_file") {
+            sinks.push_back(std::make_shared<wcc::sinks::segment_file_sink_mt>(
+                log_file_base(), max_file_size, false, max_files, compressor));
+        }
+        if (sink == "daily_file") {
+            sinks.push_back(std::make_shared<wcc::sinks::segment_file_sink_mt>(
+                log_file_base(), 0, true, max_files, compressor));
+        }
+        if (sink == "shm_ring") {  // drained by apps/log_collector
+            std::string dir = cfg["shm_ring_dir"] ? cfg["shm_ring_dir"].as<std::string>() : "/dev/shm";
+            std::string name = cfg["shm_ring_name"] ? cfg["shm_ring_name"].as<std::string>()
+                                                    : std::regex_replace(cfg["default_log_prefix"].as<std::string>(), today_regex, today_str);
+            size_t records = cfg["shm_ring_size"] ? cfg["shm_ring_size"].as<size_t>() : 1 << 16;
+            std::filesystem::create_directories(dir);
+            sinks.push_back(std::make_shared<wcc::sinks::shm_ring_sink_mt>(
+                fmt::format("{}/{}.pid.{}.ring", dir, name, getpid()), records));
         }
         if (sink == "string") {
             sinks.push_back(std::make_shared<spdlog::sinks::ostream_sink_mt>(internal::impl::s_oss));
         }
     }
 
+    // Structured event records of the HJ macros, next to the text log files
+    if (auto const& cfg_event_log = cfg["event_log"]; cfg_event_log && cfg_event_log.as<bool>())
+        internal::impl::s_event_log = std::make_unique<EventLogWriter>(log_file_base() + ".evt");
+
+    // Async mode: sinks are written by a dedicated thread pool instead of the logging thread
+    auto overflow = spdlog::async_overflow_policy::block;
+    if (auto const& cfg_async = cfg["async"]; cfg_async && cfg_async.as<bool>()) {
+        auto state = std::make_unique<internal::async_state>();
+        size_t queue_size = cfg["async_queue_size"] ? cfg["async_queue_size"].as<size_t>() : 8192;
+        state->n_threads = cfg["async_threads"] ? cfg["async_threads"].as<size_t>() : 1;
+        std::vector<int> cpus;
+        if (auto const& cfg_cpus = cfg["async_cpu_affinity"]; cfg_cpus && !cfg_cpus.IsNull())
+            cpus = cfg_cpus.as<std::vector<int>>();
+        if (auto const& cfg_overflow = cfg["async_overflow"]) {
+            auto overflow_str = cfg_overflow.as<std::string>();
+            if (overflow_str == "drop_oldest") {
+                overflow = spdlog::async_overflow_policy::overrun_oldest;
+            } else if (overflow_str == "drop_new") {
+#if SPDLOG_VERSION >= 11300
+                overflow = spdlog::async_overflow_policy::discard_new;
+#else
+                throw std::runtime_error("async_overflow drop_new needs spdlog 1.13 or later");
+#endif
+            } else if (overflow_str != "block") {
+                throw std::runtime_error(fmt::format("unknown async_overflow,{}", overflow_str));
+            }
+        }
+        state->pool = std::make_shared<spdlog::details::thread_pool>(
+            queue_size, state->n_threads, [cpus] { internal::set_thread_affinity(cpus); });
+        state->barrier_sink = std::make_shared<internal::flush_barrier_sink>(state->n_threads);
+        state->barrier = std::make_shared<spdlog::async_logger>(
+            "flush_barrier", state->barrier_sink, state->pool, spdlog::async_overflow_policy::block);
+        internal::impl::s_async = std::move(state);
+    }
+
     internal::impl::s_loggers.reserve(cfg["loggers"].size());
     for (auto const &name : cfg["loggers"]) {
         std::string name_str = name.as<std::string>();
-        internal::impl::s_loggers.emplace(name_str, spdlog::logger{name_str, std::begin(sinks), std::end(sinks)});
+        std::shared_ptr<spdlog::logger> logger;
+        if (internal::impl::s_async)
+            logger = std::make_shared<spdlog::async_logger>(name_str, std::begin(sinks), std::end(sinks),
+                                                            internal::impl::s_async->pool, overflow);
+        else
+            logger = std::make_shared<spdlog::logger>(name_str, std::begin(sinks), std::end(sinks));
+        internal::impl::s_loggers.emplace(name_str, std::move(logger));
     }
 
     auto format_str = cfg["default_format"].as<std::string>();
-    auto lvl_str = cfg["default_level"].as<std::string>();
-    auto lvl = spdlog::level::from_str(lvl_str);
-    if (lvl == spdlog::level::off)
- 	throw std::runtime_error("unknown log level");
-    for (auto [_, logger] : internal::impl::s_loggers) {
-        logger.set_pattern(format_str);
-        logger.set_level(lvl);
+    for (auto const& [_, logger] : internal::impl::s_loggers) {
+        logger->set_pattern(format_str);
     }
 
-    // special setting
-    // Disable List
-    auto const& cfg_err_loggers = cfg["set_error_loggers"];
-    if (!cfg_err_loggers.IsNull()) {
-        auto set_error_loggers = cfg_err_loggers.as<std::vector<std::string>>();
-        for (const auto &logger_name : set_error_loggers) {
-            auto& logger = internal::impl::s_loggers.at(logger_name);
-            logger.set_level(spdlog::level::err);
-        }
+    // default level with the special settings of set_error_loggers / set_debug_loggers
+    internal::apply_levels(cfg);
+
+    for (auto const& [_, logger] : internal::impl::s_loggers) {
+       logger->flush_on(spdlog::level::warn);
     }
 
-    // Enable List
-    auto const& cfg_dbg_loggers = cfg["set_debug_loggers"];
-    if (!cfg_dbg_loggers.IsNull()) {
-        auto set_debug_loggers = cfg_dbg_loggers.as<std::vector<std::string>>();
-        for (const auto &logger_name : set_debug_loggers) {
-            auto& logger = internal::impl::s_loggers.at(logger_name);
-            logger.set_level(spdlog::level::debug);
+    // Timestamp source: "system" (default) or "tsc", which stamps records with rdtsc and
+    // converts on the backend thread; spdlog loggers stamp their own messages, so tsc
+    // needs the deferred backend
+    bool tsc_clock = false;
+    if (auto const& cfg_clock = cfg["clock"]) {
+        auto clock = cfg_clock.as<std::string>();
+        if (clock != "system" && clock != "tsc")
+            throw std::runtime_error(fmt::format("unknown log clock,{}", clock));
+        tsc_clock = clock == "tsc";
+    }
+    if (tsc_clock && (!cfg["backend"] || cfg["backend"].as<std::string>() != "deferred"))
+        throw std::runtime_error("log clock tsc needs backend deferred");
+
+    // Backend of the log_* functions: "spdlog" (default) formats on the calling thread,
+    // "deferred" queues raw arguments for a background thread (see DeferredLog.h)
+    if (auto const& cfg_backend = cfg["backend"]) {
+        auto backend = cfg_backend.as<std::string>();
+        if (backend == "deferred") {
+            DeferredLogOptions opts;
+            opts.tsc = tsc_clock;
+            if (auto const& ms = cfg["tsc_recalibrate_ms"])
+                opts.tsc_recalibrate_interval = std::chrono::milliseconds(ms.as<int64_t>());
+            if (auto const& n = cfg["deferred_queue_size"]) opts.queue_size = n.as<size_t>();
+            if (auto const& overflow = cfg["deferred_overflow"]) {
+                auto overflow_str = overflow.as<std::string>();
+                if (overflow_str != "block" && overflow_str != "drop")
+                    throw std::runtime_error(fmt::format("unknown deferred_overflow,{}", overflow_str));
+                opts.block = overflow_str == "block";
+            }
+            internal::impl::s_deferred = std::make_unique<DeferredLogBackend>(opts);
+        } else if (backend != "spdlog") {
+            throw std::runtime_error(fmt::format("unknown log backend,{}", backend));
         }
     }
 
-    for (auto [_, logger] : internal::impl::s_loggers) {
-       logger.flush_on(spdlog::level::warn);
+    if (auto iter = internal::impl::s_loggers.find("main"); iter != internal::impl::s_loggers.end())
+        internal::impl::s_main = iter->second.get();
+
+    // Runtime level changes: "watch_config: true" reloads the levels whenever the config file
+    // is written, "control_fifo: <path>" takes the commands of internal::run_log_command
+    std::string watch_file, fifo_path;
+    if (auto const& cfg_watch = cfg["watch_config"]; cfg_watch && cfg_watch.as<bool>()) {
+        if (internal::impl::s_logger_config_file == "config node")
+            throw std::runtime_error("watch_config needs config_log(config_file)");
+        watch_file = internal::impl::s_logger_config_file;
     }
+    if (auto const& cfg_fifo = cfg["control_fifo"]; cfg_fifo && !cfg_fifo.IsNull()) {
+        fifo_path = std::regex_replace(cfg_fifo.as<std::string>(), std::regex("\\$\\{pid\\}"), std::to_string(getpid()));
+        if (auto dir = std::filesystem::path(fifo_path).parent_path(); !dir.empty())
+            std::filesystem::create_directories(dir);
+    }
+    if (!watch_file.empty() || !fifo_path.empty())
+        internal::impl::s_watcher = std::make_unique<LogConfigWatcher>(watch_file, fifo_path, internal::run_log_command);
 
     once = true;
 }
 
 inline void config_log(std::string_view config_file) {
+    if (!internal::impl::s_loggers.empty()) {  // configured before; the watcher may be reading the file name
+        config_log(YAML::Node());
+        return;
+    }
     internal::impl::s_logger_config_file = config_file;
     YAML::Node cfg = YAML::LoadFile(internal::impl::s_logger_config_file);
     config_log(cfg);
 }
 
+// Re-apply default_level, set_error_loggers and set_debug_loggers to the configured loggers;
+// loggers, sinks and formats stay as config_log made them. Log calls are never blocked.
+inline void reload_log_levels(YAML::Node const& cfg) { internal::apply_levels(cfg); }
+
+// Same from the file given to config_log
+inline void reload_log_levels() { internal::run_log_command("reload"); }
+
+inline void set_log_level(std::string_view logger_name, std::string_view lvl) {
+    auto* logger = get_logger(logger_name);
+    auto level = internal::level_from_str(lvl);
+    std::lock_guard lock(internal::impl::s_reload_mutex);
+    internal::impl::s_restores.erase(logger->name());  // set for good
+    logger->set_level(level);
+}
+
 // Following needs c++20
 template <size_t N> struct StringLiteral {
     constexpr StringLiteral(const char (&str)[N]) {
@@ -167,44 +496,118 @@ template <size_t N> struct StringLiteral {
     char value[N];
 };
 
+// Logger looked up once per name and then served from a static; use after config_log
+template <StringLiteral STR>
+inline spdlog::logger* get_logger() {
+    static spdlog::logger* p_logger = get_logger(STR.value);
+    return p_logger;
+}
+
+// Format string of the log_* functions: checked at compile time like fmt::format_string, and
+// remembers whether it came from fmt::runtime, whose text the deferred backend has to copy
+template <typename... Args>
+class log_format_string {
+public:
+    template <typename S, typename = std::enable_if_t<std::is_convertible_v<S const&, fmt::string_view>>>
+    FMT_CONSTEVAL log_format_string(S const& s) : fmt_(s) {}
+    log_format_string(internal::runtime_format_t s) : fmt_(s), runtime_(true) {}
+
+    fmt::format_string<Args...> get() const { return fmt_; }
+    bool is_runtime() const { return runtime_; }
+
+private:
+    fmt::format_string<Args...> fmt_;
+    bool runtime_ = false;
+};
+
+template <typename... Args>
+using format_string_t = log_format_string<std::type_identity_t<Args>...>;
+
+namespace internal {
+
+// Common path of the log_* functions: synchronous spdlog or the deferred backend
 template <typename... Args>
-using format_string_t = spdlog::format_string_t<Args...>;
+inline void log_to(spdlog::logger* logger, spdlog::level::level_enum lvl, format_string_t<Args...> fmt, Args &&...args) {
+    if (auto* backend = impl::s_deferred.get()) {
+        if (!logger->should_log(lvl)) return;
+        if (fmt.is_runtime()) [[unlikely]] {
+            backend->log(logger, lvl, fmt::runtime(fmt::string_view(fmt.get())), std::forward<Args>(args)...);
+        } else {
+            backend->log(logger, lvl, fmt.get(), std::forward<Args>(args)...);
+        }
+    } else {
+        logger->log(lvl, fmt.get(), std::forward<Args>(args)...);
+    }
+}
+
+// Path of the HJ macros: the text line plus, if enabled, the structured event record
+template <size_t N, bool HasId, typename... Args>
+inline void log_event_to(spdlog::logger* logger, spdlog::level::level_enum lvl, EventSite<N, HasId> const& site,
+                         format_string_t<Args...> fmt, Args &&...args) {
+    if (auto* events = impl::s_event_log.get()) [[unlikely]] {
+        if (logger->should_log(lvl)) events->write(logger->name(), lvl, site, args...);
+    }
+    log_to(logger, lvl, fmt, std::forward<Args>(args)...);
+}
+
+inline void flush(spdlog::logger* logger) {
+    if (impl::s_event_log) impl::s_event_log->flush();
+    if (impl::s_deferred) impl::s_deferred->drain();
+    logger->flush();
+    if (impl::s_async) wait_async();
+}
+
+// Logger of the free log_* functions: a single load once config_log has run
+inline spdlog::logger* main_logger() {
+    if (auto* p_logger = impl::s_main) [[likely]] return p_logger;
+    return get_logger("main");  // throws MissingLogger
+}
+
+} // namespace internal
 
 template <StringLiteral STR> class AttachLogger {
 public:
-    AttachLogger() : p_logger_(get_logger(STR.value)) {}
+    AttachLogger() : p_logger_(get_logger<STR>()) {}
 
     template <typename... Args>
     void log_trace(format_string_t<Args...> fmt, Args &&...args) const {
-        p_logger_->trace(fmt, std::forward<Args>(args)...);
+        internal::log_to(p_logger_, spdlog::level::trace, fmt, std::forward<Args>(args)...);
     }
 
     template <typename... Args>
     void log_debug(format_string_t<Args...> fmt, Args &&...args) const {
-        p_logger_->debug(fmt, std::forward<Args>(args)...);
+        internal::log_to(p_logger_, spdlog::level::debug, fmt, std::forward<Args>(args)...);
     }
 
     template <typename... Args>
     void log_info(format_string_t<Args...> fmt, Args &&...args) const {
-        p_logger_->info(fmt, std::forward<Args>(args)...);
+        internal::log_to(p_logger_, spdlog::level::info, fmt, std::forward<Args>(args)...);
     }
 
     template <typename... Args>
     void log_warn(format_string_t<Args...> fmt, Args &&...args) const {
-        p_logger_->warn(fmt, std::forward<Args>(args)...);
+        internal::log_to(p_logger_, spdlog::level::warn, fmt, std::forward<Args>(args)...);
     }
 
     template <typename... Args>
     void log_error(format_string_t<Args...> fmt, Args &&...args) const {
-        p_logger_->error(fmt, std::forward<Args>(args)...);
+        internal::log_to(p_logger_, spdlog::level::err, fmt, std::forward<Args>(args)...);
     }
 
     template <typename... Args>
     void log_critical(format_string_t<Args...> fmt, Args &&...args) const {
-        p_logger_->critical(fmt, std::forward<Args>(args)...);
+        internal::log_to(p_logger_, spdlog::level::critical, fmt, std::forward<Args>(args)...);
     }
 
-    void log_flush() const { p_logger_->flush(); }
+    template <size_t N, bool HasId, typename... Args>
+    void log_event(spdlog::level::level_enum lvl, EventSite<N, HasId> const& site,
+                   format_string_t<Args...> fmt, Args &&...args) const {
+        internal::log_event_to(p_logger_, lvl, site, fmt, std::forward<Args>(args)...);
+    }
+
+    bool log_enabled(spdlog::level::level_enum lvl) const { return p_logger_->should_log(lvl); }
+
+    void log_flush() const { internal::flush(p_logger_); }
 
 protected:
     mutable spdlog::logger* p_logger_;
@@ -215,40 +618,51 @@ protected:
 
 template <typename... Args>
 inline void log_trace(format_string_t<Args...> fmt, Args &&...args) {
-    get_logger("main")->trace(fmt, std::forward<Args>(args)...);
+    internal::log_to(internal::main_logger(), spdlog::level::trace, fmt, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 inline void log_debug(format_string_t<Args...> fmt, Args &&...args) {
-    get_logger("main")->debug(fmt, std::forward<Args>(args)...);
+    internal::log_to(internal::main_logger(), spdlog::level::debug, fmt, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 void log_info(format_string_t<Args...> fmt, Args &&...args) {
-    get_logger("main")->info(fmt, std::forward<Args>(args)...);
+    internal::log_to(internal::main_logger(), spdlog::level::info, fmt, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 inline void log_warn(format_string_t<Args...> fmt, Args &&...args) {
-    get_logger("main")->warn(fmt, std::forward<Args>(args)...);
+    internal::log_to(internal::main_logger(), spdlog::level::warn, fmt, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 inline void log_error(format_string_t<Args...> fmt, Args &&...args) {
-    get_logger("main")->error(fmt, std::forward<Args>(args)...);
+    internal::log_to(internal::main_logger(), spdlog::level::err, fmt, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 inline void log_critical(format_string_t<Args...> fmt, Args &&...args) {
-    get_logger("main")->critical(fmt, std::forward<Args>(args)...);
+    internal::log_to(internal::main_logger(), spdlog::level::critical, fmt, std::forward<Args>(args)...);
 }
 
-inline void log_flush() { get_logger("main")->flush(); }
+template <size_t N, bool HasId, typename... Args>
+inline void log_event(spdlog::level::level_enum lvl, EventSite<N, HasId> const& site,
+                      format_string_t<Args...> fmt, Args &&...args) {
+    internal::log_event_to(internal::main_logger(), lvl, site, fmt, std::forward<Args>(args)...);
+}
+
+inline bool log_enabled(spdlog::level::level_enum lvl) { return internal::main_logger()->should_log(lvl); }
+
+inline void log_flush() { internal::flush(internal::main_logger()); }
 
 inline void log_flush_all() {
-    for (auto [_, logger] : internal::impl::s_loggers) {
-       logger.flush();
+    if (internal::impl::s_event_log) internal::impl::s_event_log->flush();
+    if (internal::impl::s_deferred) internal::impl::s_deferred->drain();
+    for (auto const& [_, logger] : internal::impl::s_loggers) {
+       logger->flush();
     }
+    if (internal::impl::s_async) internal::wait_async();
 }
 
 // get_source_function_name: used by macros following
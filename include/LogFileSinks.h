@@ -0,0 +1,282 @@
+/**
+ * @file LogFileSinks.h
+ * @brief Size-capped and daily file sinks for config_log, with background compression.
+ *
+ * segment_file_sink writes numbered (size rotation) or dated (daily rotation) segments and
+ * keeps at most max_files closed ones. Closed segments are handed to a SegmentCompressor,
+ * which compresses them on a SCHED_IDLE thread so logging threads never wait for it.
+ *
+ * gzip needs zlib (WCC_LOG_GZIP) and zstd needs libzstd (WCC_LOG_ZSTD); both macros are set
+ * by the LogConfig cmake target when the libraries are found.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <fmt/format.h>
+#include <spdlog/details/file_helper.h>
+#include <spdlog/sinks/base_sink.h>
+#ifdef WCC_LOG_GZIP
+#include <zlib.h>
+#endif
+#ifdef WCC_LOG_ZSTD
+#include <zstd.h>
+#endif
+
+namespace wcc {
+
+enum class LogCompression { none, gzip, zstd };
+
+inline LogCompression log_compression_from_str(std::string_view str) {
+    if (str == "none") return LogCompression::none;
+#ifdef WCC_LOG_GZIP
+    if (str == "gzip") return LogCompression::gzip;
+#endif
+#ifdef WCC_LOG_ZSTD
+    if (str == "zstd") return LogCompression::zstd;
+#endif
+    throw std::runtime_error(fmt::format("unsupported log compression,{}", str));
+}
+
+inline std::string_view log_compression_ext(LogCompression method) {
+    switch (method) {
+        case LogCompression::gzip: return ".gz";
+        case LogCompression::zstd: return ".zst";
+        default: return "";
+    }
+}
+
+// Compress path into path + ext and remove path; returns false (keeping path) on any error
+inline bool compress_log_file(std::string const& path, LogCompression method) {
+    if (method == LogCompression::none) return true;
+    std::string out_path = path + std::string(log_compression_ext(method));
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (in == nullptr) return false;
+    std::vector<char> buf(1 << 16);
+    bool ok = false;
+
+#ifdef WCC_LOG_GZIP
+    if (method == LogCompression::gzip) {
+        if (gzFile out = gzopen(out_path.c_str(), "wb6")) {
+            ok = true;
+            for (size_t n; ok && (n = std::fread(buf.data(), 1, buf.size(), in)) > 0; )
+                ok = gzwrite(out, buf.data(), static_cast<unsigned>(n)) == static_cast<int>(n);
+            ok = gzclose(out) == Z_OK && ok;
+        }
+    }
+#endif
+#ifdef WCC_LOG_ZSTD
+    if (method == LogCompression::zstd) {
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        std::FILE* out = std::fopen(out_path.c_str(), "wb");
+        if (cctx && out) {
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 3);
+            std::vector<char> zbuf(ZSTD_CStreamOutSize());
+            ok = true;
+            for (bool last = false; ok && !last; ) {
+                size_t n = std::fread(buf.data(), 1, buf.size(), in);
+                last = n < buf.size();
+                ZSTD_inBuffer input{buf.data(), n, 0};
+                for (bool done = false; ok && !done; ) {
+                    ZSTD_outBuffer output{zbuf.data(), zbuf.size(), 0};
+                    size_t rc = ZSTD_compressStream2(cctx, &output, &input, last ? ZSTD_e_end : ZSTD_e_continue);
+                    ok = !ZSTD_isError(rc) && std::fwrite(zbuf.data(), 1, output.pos, out) == output.pos;
+                    done = last ? rc == 0 : input.pos == input.size;
+                }
+            }
+        }
+        if (out) ok = std::fclose(out) == 0 && ok;
+        ZSTD_freeCCtx(cctx);
+    }
+#endif
+
+    std::fclose(in);
+    std::error_code ec;
+    if (ok) std::filesystem::remove(path, ec);
+    else std::filesystem::remove(out_path, ec);
+    return ok;
+}
+
+// Background compression of closed log segments on a SCHED_IDLE thread
+class SegmentCompressor {
+public:
+    explicit SegmentCompressor(LogCompression method) : method_(method), worker_([this] { run(); }) {}
+
+    SegmentCompressor(SegmentCompressor const&) = delete;
+    SegmentCompressor& operator=(SegmentCompressor const&) = delete;
+
+    ~SegmentCompressor() {  // finishes the queued segments
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        worker_.join();
+    }
+
+    LogCompression method() const { return method_; }
+
+    void submit(std::string path) {
+        {
+            std::lock_guard lock(mutex_);
+            queue_.push_back({std::move(path), false});
+        }
+        cv_.notify_one();
+    }
+
+    // Delete a segment given to submit() and its compressed file. A segment still queued is
+    // not compressed; one being compressed is deleted once the compression is done.
+    void remove(std::string path) {
+        {
+            std::lock_guard lock(mutex_);
+            std::erase_if(queue_, [&path](Task const& t) { return !t.remove && t.path == path; });
+            queue_.push_back({std::move(path), true});
+        }
+        cv_.notify_one();
+    }
+
+    // Wait until every submitted segment has been processed
+    void wait_idle() {
+        std::unique_lock lock(mutex_);
+        idle_cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+    }
+
+private:
+    void run() {
+        sched_param param{};
+        pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+        std::unique_lock lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) return;  // stop_ and drained
+            Task task = std::move(queue_.front());
+            queue_.pop_front();
+            busy_ = true;
+            lock.unlock();
+            if (task.remove) {
+                std::error_code ec;
+                std::filesystem::remove(task.path, ec);
+                std::filesystem::remove(task.path + std::string(log_compression_ext(method_)), ec);
+            } else if (!compress_log_file(task.path, method_)) {
+                fmt::print(stderr, "SegmentCompressor,CompressFailed,file={}\n", task.path);
+            }
+            lock.lock();
+            busy_ = false;
+            if (queue_.empty()) idle_cv_.notify_all();
+        }
+    }
+
+    struct Task {
+        std::string path;
+        bool remove;  // else compress
+    };
+
+    LogCompression method_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable idle_cv_;
+    std::deque<Task> queue_;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::thread worker_;  // last: started after everything above is initialized
+};
+
+namespace sinks {
+
+// File sink writing <base>.<seq>.log segments of at most max_size bytes (max_size > 0), or
+// <base>.<YYYYMMDD>.log segments switched at local midnight (daily). Keeps the last max_files
+// closed segments (0: all) and hands each closed segment to the compressor if one is given.
+template <typename Mutex>
+class segment_file_sink final : public spdlog::sinks::base_sink<Mutex> {
+public:
+    segment_file_sink(std::string base, size_t max_size, bool daily, size_t max_files,
+                      std::shared_ptr<SegmentCompressor> compressor = nullptr)
+        : base_(std::move(base)), max_size_(max_size), daily_(daily), max_files_(max_files),
+          compressor_(std::move(compressor)) {
+        open_segment(spdlog::log_clock::now());
+    }
+
+    ~segment_file_sink() override {
+        // the last segment stays uncompressed so that a restarted process can find it
+        file_.close();
+    }
+
+    std::string const& filename() const { return file_.filename(); }
+
+protected:
+    void sink_it_(spdlog::details::log_msg const& msg) override {
+        if (daily_ && msg.time >= next_day_) rotate(msg.time);
+        spdlog::memory_buf_t formatted;
+        spdlog::sinks::base_sink<Mutex>::formatter_->format(msg, formatted);
+        if (max_size_ > 0 && file_size_ > 0 && file_size_ + formatted.size() > max_size_) rotate(msg.time);
+        file_.write(formatted);
+        file_size_ += formatted.size();
+    }
+
+    void flush_() override { file_.flush(); }
+
+private:
+    void open_segment(spdlog::log_clock::time_point now) {
+        std::string name;
+        if (daily_) {
+            auto t = spdlog::log_clock::to_time_t(now);
+            std::tm tm = *std::localtime(&t);
+            name = fmt::format("{}.{:04d}{:02d}{:02d}.log", base_, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+            tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+            tm.tm_mday += 1;
+            tm.tm_isdst = -1;
+            next_day_ = spdlog::log_clock::from_time_t(std::mktime(&tm));
+        } else {
+            name = fmt::format("{}.{}.log", base_, seq_++);
+        }
+        file_.open(name, false);
+        file_size_ = file_.size();
+    }
+
+    void rotate(spdlog::log_clock::time_point now) {
+        std::string closed = file_.filename();
+        file_.close();
+        if (compressor_) compressor_->submit(closed);
+        closed_.push_back(closed);
+        while (max_files_ > 0 && closed_.size() > max_files_) {
+            if (compressor_) {
+                compressor_->remove(closed_.front());  // ordered after its compression
+            } else {
+                std::error_code ec;
+                std::filesystem::remove(closed_.front(), ec);
+            }
+            closed_.pop_front();
+        }
+        open_segment(now);
+    }
+
+    std::string base_;
+    size_t max_size_;
+    bool daily_;
+    size_t max_files_;
+    std::shared_ptr<SegmentCompressor> compressor_;
+
+    spdlog::details::file_helper file_;
+    size_t file_size_ = 0;
+    size_t seq_ = 0;
+    spdlog::log_clock::time_point next_day_{};
+    std::deque<std::string> closed_;
+};
+
+using segment_file_sink_mt = segment_file_sink<std::mutex>;
+
+} // namespace sinks
+
+} // namespace wcc
@@ -0,0 +1,128 @@
+/**
+ * @file LogLimit.h
+ * @brief Per call site log limiters used by the *_EVERY_N / *_RATE / *_DEDUP HJ macros.
+ *
+ * Each macro call site keeps its limiter in a function-local static thread_local, so a
+ * check is a few arithmetic ops with no lookup and no sharing between threads. admit()
+ * returns whether the line is written, and sets suppressed to the number of lines this
+ * site dropped since the last written one.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <fmt/format.h>
+
+namespace wcc {
+
+// Writes the 1st, (n+1)th, (2n+1)th ... line
+class LogEveryN {
+public:
+    explicit LogEveryN(uint64_t n) : n_(n ? n : 1) {}
+
+    bool admit(uint64_t& suppressed) {
+        if (count_++ % n_ != 0) return false;
+        suppressed = count_ == 1 ? 0 : n_ - 1;
+        return true;
+    }
+
+private:
+    uint64_t n_;
+    uint64_t count_ = 0;
+};
+
+// Token bucket: at most per_sec lines per second on average, bursts of up to burst lines
+class LogRateLimit {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit LogRateLimit(double per_sec, double burst = 0)
+        : per_ns_(per_sec * 1e-9), burst_(burst > 0 ? burst : std::max(per_sec, 1.0)), tokens_(burst_) {}
+
+    bool admit(uint64_t& suppressed) {
+        auto now = clock::now();
+        if (now != last_) {
+            tokens_ = std::min(burst_, tokens_ + static_cast<double>((now - last_).count()) * per_ns_);
+            last_ = now;
+        }
+        if (tokens_ < 1) {
+            ++suppressed_;
+            return false;
+        }
+        tokens_ -= 1;
+        suppressed = suppressed_;
+        suppressed_ = 0;
+        return true;
+    }
+
+private:
+    static_assert(std::is_same_v<clock::duration, std::chrono::nanoseconds>);
+
+    double per_ns_;
+    double burst_;
+    double tokens_;
+    clock::time_point last_ = clock::now();
+    uint64_t suppressed_ = 0;
+};
+
+// Drops a line whose values repeat the last written one within window
+class LogDedup {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit LogDedup(clock::duration window) : window_(window) {}
+
+    bool admit(size_t hash, uint64_t& suppressed) {
+        auto now = clock::now();
+        if (written_ && hash == hash_ && now - last_ < window_) {
+            ++suppressed_;
+            return false;
+        }
+        written_ = true;
+        hash_ = hash;
+        last_ = now;
+        suppressed = suppressed_;
+        suppressed_ = 0;
+        return true;
+    }
+
+private:
+    clock::duration window_;
+    bool written_ = false;
+    size_t hash_ = 0;
+    clock::time_point last_{};
+    uint64_t suppressed_ = 0;
+};
+
+namespace internal {
+
+template <typename T>
+size_t hash_value(T const& v) {
+    using D = std::decay_t<T>;
+    if constexpr (std::is_convertible_v<T const&, std::string_view>) return std::hash<std::string_view>{}(v);
+    else if constexpr (requires { std::hash<D>{}(v); }) return std::hash<D>{}(v);
+    else return std::hash<std::string>{}(fmt::format("{}", v));
+}
+
+template <typename... Ts>
+size_t hash_values(Ts const&... vs) {
+    size_t h = 0;
+    ((h ^= hash_value(vs) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)), ...);
+    return h;
+}
+
+// Evaluates the macro arguments once and hands them to f
+template <typename F, typename... Ts>
+void invoke_with(F&& f, Ts const&... vs) {
+    std::forward<F>(f)(vs...);
+}
+
+} // namespace internal
+
+} // namespace wcc
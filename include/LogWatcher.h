@@ -0,0 +1,154 @@
+/**
+ * @file LogWatcher.h
+ * @brief Background thread feeding log control commands to a handler at runtime.
+ *
+ * Commands come from two optional sources: a change of the config file (inotify on its
+ * directory, so that editors replacing the file are seen too) yields "reload", and every
+ * line written to a FifoFile control pipe is passed on as is, e.g.
+ *   echo "level Test debug 300s" > log/ctl.fifo
+ * schedule() queues a command to run later on the same thread, which is how LogConfig
+ * restores a temporarily raised level. The handler always runs on the watcher thread;
+ * an exception thrown by it is reported on stderr and the watcher keeps going.
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <fmt/format.h>
+#include "FifoFile.h"
+
+namespace wcc {
+
+class LogConfigWatcher {
+public:
+    using clock = std::chrono::steady_clock;
+    using Handler = std::function<void(std::string_view command)>;
+
+    // Either path may be empty to leave that source out
+    LogConfigWatcher(std::string const& config_file, std::string const& fifo_path, Handler handler)
+        : handler_(std::move(handler)) {
+        if (!config_file.empty()) {
+            std::filesystem::path path(config_file);
+            file_name_ = path.filename().string();
+            std::string dir = path.has_parent_path() ? path.parent_path().string() : ".";
+            inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (inotify_fd_ < 0 || inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+                if (inotify_fd_ >= 0) close(inotify_fd_);
+                throw std::runtime_error(fmt::format("LogConfigWatcher,WatchFailed,{},{}", dir, strerror(errno)));
+            }
+        }
+        if (!fifo_path.empty()) {
+            fifo_ = std::make_unique<FifoFile>(fifo_path);
+            // keep a writer open so that poll does not report POLLHUP after each client leaves
+            fifo_writer_ = open(fifo_path.c_str(), O_WRONLY | O_NONBLOCK);
+        }
+        worker_ = std::thread([this] { run(); });
+    }
+
+    LogConfigWatcher(LogConfigWatcher const&) = delete;
+    LogConfigWatcher& operator=(LogConfigWatcher const&) = delete;
+
+    ~LogConfigWatcher() {
+        stop_.store(true, std::memory_order_release);
+        worker_.join();
+        if (inotify_fd_ >= 0) close(inotify_fd_);
+        if (fifo_writer_ >= 0) close(fifo_writer_);
+    }
+
+    // Run command on the watcher thread after delay; callable from any thread
+    void schedule(clock::duration delay, std::string command) {
+        std::lock_guard lock(mutex_);
+        scheduled_.emplace(clock::now() + delay, std::move(command));
+    }
+
+private:
+    void run() {
+        while (!stop_.load(std::memory_order_acquire)) {
+            pollfd fds[2];
+            nfds_t n = 0;
+            if (inotify_fd_ >= 0) fds[n++] = {inotify_fd_, POLLIN, 0};
+            if (fifo_) fds[n++] = {*fifo_, POLLIN, 0};
+            if (::poll(fds, n, k_poll_ms) > 0) {
+                for (nfds_t i = 0; i < n; ++i) {
+                    if (!(fds[i].revents & POLLIN)) continue;
+                    if (fds[i].fd == inotify_fd_) read_inotify();
+                    else read_fifo();
+                }
+            }
+            run_scheduled();
+        }
+    }
+
+    void read_inotify() {
+        alignas(inotify_event) char buf[4096];
+        bool changed = false;
+        for (ssize_t len; (len = read(inotify_fd_, buf, sizeof(buf))) > 0; ) {
+            for (char* p = buf; p < buf + len; ) {
+                auto* ev = reinterpret_cast<inotify_event*>(p);
+                changed = changed || (ev->len > 0 && file_name_ == ev->name);
+                p += sizeof(inotify_event) + ev->len;
+            }
+        }
+        if (changed) dispatch("reload");
+    }
+
+    void read_fifo() {
+        char buf[4096];
+        for (ssize_t len; (len = read(*fifo_, buf, sizeof(buf))) > 0; ) pending_.append(buf, len);
+        for (size_t eol; (eol = pending_.find('\n')) != std::string::npos; ) {
+            std::string line = pending_.substr(0, eol);
+            pending_.erase(0, eol + 1);
+            if (line.find_first_not_of(" \t\r") != std::string::npos) dispatch(line);
+        }
+    }
+
+    void run_scheduled() {
+        for (;;) {
+            std::string command;
+            {
+                std::lock_guard lock(mutex_);
+                if (scheduled_.empty() || scheduled_.begin()->first > clock::now()) return;
+                command = std::move(scheduled_.begin()->second);
+                scheduled_.erase(scheduled_.begin());
+            }
+            dispatch(command);
+        }
+    }
+
+    void dispatch(std::string_view command) {
+        try {
+            handler_(command);
+        } catch (std::exception const& e) {
+            fmt::print(stderr, "LogConfigWatcher,CommandFailed,command={},error={}\n", command, e.what());
+        }
+    }
+
+    static constexpr int k_poll_ms = 100;  // also bounds the delay of scheduled commands and of stopping
+
+    Handler handler_;
+    std::string file_name_;
+    int inotify_fd_ = -1;
+    std::unique_ptr<FifoFile> fifo_;
+    int fifo_writer_ = -1;
+    std::string pending_;  // partial fifo line
+
+    std::mutex mutex_;  // guards scheduled_
+    std::multimap<clock::time_point, std::string> scheduled_;
+    std::atomic<bool> stop_{false};
+    std::thread worker_;  // last: started after everything above is initialized
+};
+
+} // namespace wcc
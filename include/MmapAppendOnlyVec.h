@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>    // strerror
+#include <sys/file.h>  // flock
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace wcc {
+
+/**
+ * MmapAppendOnlyVec: AppendOnlyVec persisted in a memory mapped file.
+ *
+ * The file is a header page followed by the elements, growing ChunkSize elements at a
+ * time. The header records the layout (checked on open) and the committed number of
+ * elements, which is stored with release order after the element is written. Reopening
+ * after a crash maps the file again in O(1), elements not committed are discarded.
+ *
+ * A large range of address space is reserved up front and the file is mapped at its
+ * start, each growth mapping the new part right after the old one. So elements are
+ * contiguous in memory, never moved, and indexing is a plain pointer offset.
+ *
+ * Modes, as H5File:
+ *   'w' create or truncate for writing
+ *   'a' open or create for appending
+ *   'r' read only, following the size published by a writer of the same file, possibly
+ *       in another process
+ * At most one writer is allowed per file, enforced by an exclusive flock.
+ * Page cache keeps committed elements when the process crashes, call sync() for durability
+ * against a system crash.
+ *
+ * Only trivially copyable T, the bytes are the file format.
+ * An instance is used by one thread; readers in other threads or processes open their own.
+ */
+template <typename T, size_t ChunkSize>
+class MmapAppendOnlyVec {
+    static_assert(std::is_trivially_copyable_v<T>, "MmapAppendOnlyVec stores raw bytes of T");
+    static_assert((ChunkSize & (ChunkSize-1)) == 0, "ChunkSize must be power of 2");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "size is shared across processes");
+
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t elem_size;
+        uint64_t chunk_size;
+        std::atomic<uint64_t> num_chunks;  // chunks the file holds, updated after the file is extended
+        std::atomic<uint64_t> size;        // committed elements
+    };
+
+public:
+    using value_type      = T;
+    using size_type       = size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference       = T&;
+    using const_reference = T const&;
+    using pointer         = T*;
+    using const_pointer   = T const*;
+    using iterator        = T*;
+    using const_iterator  = T const*;
+
+    constexpr static uint64_t k_magic   = 0x3130564F41434357;  // "WCCAOV01"
+    constexpr static uint32_t k_version = 1;
+
+    // max_bytes is the address space reserved for the mapping, not memory nor disk usage
+    MmapAppendOnlyVec(std::string const& file_name, char mode = 'r', size_t max_bytes = size_t(1) << 40)
+        : MmapAppendOnlyVec(file_name, mode, max_bytes, false)
+    {}
+
+    ~MmapAppendOnlyVec() { release(); }
+
+    MmapAppendOnlyVec(MmapAppendOnlyVec const&) = delete;
+    MmapAppendOnlyVec& operator=(MmapAppendOnlyVec const&) = delete;
+
+protected:
+    // shm: file_name is a POSIX shared memory object name, e.g. "/md.trades", opened by shm_open
+    MmapAppendOnlyVec(std::string const& file_name, char mode, size_t max_bytes, bool shm)
+        : file_name_(file_name)
+        , mode_(mode)
+    {
+        if (mode != 'r' && mode != 'w' && mode != 'a') {
+            throw std::invalid_argument("MmapAppendOnlyVec,InvalidOpenMode");
+        }
+        int flags = read_only() ? O_RDONLY : O_RDWR | O_CREAT;
+        fd_ = shm ? shm_open(file_name_.c_str(), flags, 0644) : open(file_name_.c_str(), flags, 0644);
+        if (fd_ == -1) {
+            throw std::runtime_error("MmapAppendOnlyVec,OpenFileFailed: " + file_name_ + ": " + strerror(errno));
+        }
+        // take the writer lock before truncating, so a running writer is not clobbered
+        if (!read_only() && flock(fd_, LOCK_EX | LOCK_NB) == -1) {
+            release();
+            throw std::runtime_error("MmapAppendOnlyVec,WriterExists: " + file_name_);
+        }
+        if (mode == 'w' && ftruncate(fd_, 0) == -1) {
+            release();
+            throw std::runtime_error("MmapAppendOnlyVec,TruncateFailed: " + file_name_ + ": " + strerror(errno));
+        }
+        try {
+            init(max_bytes);
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+public:
+    // committed size, for readers also maps the elements written since last call
+    size_type size() const {
+        size_type n = header_->size.load(std::memory_order_acquire);
+        if (n > capacity_) [[unlikely]] const_cast<MmapAppendOnlyVec*>(this)->map_chunks();
+        return n;
+    }
+    bool empty() const { return !size(); }
+    size_type capacity() const { return capacity_; }
+    bool read_only() const { return mode_ == 'r'; }
+
+    T&       operator[](size_type i)       { assert(i < size()); return data_[i]; }
+    T const& operator[](size_type i) const { assert(i < size()); return data_[i]; }
+
+    T&       front()       { return data_[0]; }
+    T const& front() const { return data_[0]; }
+    T&       back()        { return data_[size()-1]; }
+    T const& back()  const { return data_[size()-1]; }
+
+    T*       data()       { return data_; }
+    T const* data() const { return data_; }
+
+    iterator begin() { return data_; }
+    iterator end()   { return data_ + size(); }
+    const_iterator begin() const { return data_; }
+    const_iterator end()   const { return data_ + size(); }
+
+    void push_back(T const& t) {
+        emplace_back(t);
+    }
+
+    template <typename... Args>
+    reference emplace_back(Args&&... args) {
+        size_type n = header_->size.load(std::memory_order_relaxed);
+        if (n >= write_capacity_) [[unlikely]] grow(n + 1);
+        T* p = ::new (static_cast<void*>(data_ + n)) T(std::forward<Args>(args)...);
+        header_->size.store(n + 1, std::memory_order_release);  // commit
+        return *p;
+    }
+
+    // memcpy all elements of s, committed at once
+    void append(std::span<const T> s) {
+        size_type n = header_->size.load(std::memory_order_relaxed);
+        if (n + s.size() > write_capacity_) grow(n + s.size());
+        if (!s.empty()) std::memcpy(data_ + n, s.data(), s.size_bytes());
+        header_->size.store(n + s.size(), std::memory_order_release);  // commit
+    }
+
+    // flush committed elements to disk
+    void sync() {
+        size_t len = data_offset() + header_->size.load(std::memory_order_relaxed) * sizeof(T);
+        if (msync(base_, round_up(len, page_size_), MS_SYNC) == -1) {
+            throw std::runtime_error("MmapAppendOnlyVec,SyncFailed: " + file_name_ + ": " + strerror(errno));
+        }
+    }
+
+private:
+    static size_t round_up(size_t n, size_t unit) { return (n + unit - 1) / unit * unit; }
+    size_t data_offset() const { return page_size_; }  // header takes the first page
+    size_t file_bytes(uint64_t num_chunks) const { return data_offset() + round_up(num_chunks * ChunkSize * sizeof(T), page_size_); }
+
+    void init(size_t max_bytes) {
+        page_size_ = size_t(sysconf(_SC_PAGESIZE));
+        reserved_bytes_ = round_up(max_bytes, page_size_);
+
+        struct stat sb;
+        if (fstat(fd_, &sb) == -1) {
+            throw std::runtime_error("MmapAppendOnlyVec,StatFailed: " + file_name_);
+        }
+        bool fresh = sb.st_size == 0;
+        if (fresh) {
+            if (read_only()) throw std::runtime_error("MmapAppendOnlyVec,EmptyFile: " + file_name_);
+            if (ftruncate(fd_, data_offset()) == -1) {
+                throw std::runtime_error("MmapAppendOnlyVec,TruncateFailed: " + file_name_ + ": " + strerror(errno));
+            }
+        } else if (size_t(sb.st_size) < data_offset()) {
+            throw std::runtime_error("MmapAppendOnlyVec,BadHeader: " + file_name_);
+        }
+
+        // reserve address space, then map the file over its start
+        base_ = static_cast<char*>(mmap(nullptr, reserved_bytes_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+        if (base_ == MAP_FAILED) {
+            base_ = nullptr;
+            throw std::runtime_error("MmapAppendOnlyVec,ReserveFailed: " + file_name_ + ": " + strerror(errno));
+        }
+        map_range(0, data_offset());
+        header_ = reinterpret_cast<Header*>(base_);
+        data_ = reinterpret_cast<T*>(base_ + data_offset());
+
+        if (fresh) {
+            header_->magic      = k_magic;
+            header_->version    = k_version;
+            header_->elem_size  = sizeof(T);
+            header_->chunk_size = ChunkSize;
+            header_->num_chunks.store(0, std::memory_order_relaxed);
+            header_->size.store(0, std::memory_order_release);
+        } else if (header_->magic != k_magic || header_->version != k_version) {
+            throw std::runtime_error("MmapAppendOnlyVec,BadHeader: " + file_name_);
+        } else if (header_->elem_size != sizeof(T) || header_->chunk_size != ChunkSize) {
+            throw std::runtime_error("MmapAppendOnlyVec,LayoutMismatch: " + file_name_);
+        }
+        if (!read_only()) {
+            // a crash may leave the file extended beyond what the header records, or the
+            // other way round if the file was copied partially; trust the smaller one
+            uint64_t num_chunks = std::min<uint64_t>(header_->num_chunks.load(std::memory_order_relaxed),
+                                                     (std::max<size_t>(sb.st_size, data_offset()) - data_offset()) / (ChunkSize * sizeof(T)));
+            header_->num_chunks.store(num_chunks, std::memory_order_release);
+            header_->size.store(std::min<uint64_t>(header_->size.load(std::memory_order_relaxed), num_chunks * ChunkSize),
+                                std::memory_order_release);
+        }
+        map_chunks();
+    }
+
+    // maps chunks recorded in the header but not mapped yet
+    void map_chunks() {
+        uint64_t num_chunks = header_->num_chunks.load(std::memory_order_acquire);
+        size_t len = file_bytes(num_chunks);
+        if (len > mapped_bytes_) map_range(mapped_bytes_, len);
+        capacity_ = num_chunks * ChunkSize;
+        if (!read_only()) write_capacity_ = capacity_;
+    }
+
+    void map_range(size_t from, size_t to) {
+        if (to > reserved_bytes_) {
+            throw std::runtime_error("MmapAppendOnlyVec,ExceedMaxBytes: " + file_name_);
+        }
+        int prot = read_only() ? PROT_READ : PROT_READ | PROT_WRITE;
+        void* addr = mmap(base_ + from, to - from, prot, MAP_SHARED | MAP_FIXED, fd_, off_t(from));
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("MmapAppendOnlyVec,MapFailed: " + file_name_ + ": " + strerror(errno));
+        }
+        mapped_bytes_ = to;
+    }
+
+    // writer only: extend the file by whole chunks to hold n elements
+    void grow(size_type n) {
+        if (read_only()) throw std::logic_error("MmapAppendOnlyVec,ReadOnly: " + file_name_);
+        uint64_t num_chunks = (n + ChunkSize - 1) / ChunkSize;
+        if (ftruncate(fd_, off_t(file_bytes(num_chunks))) == -1) {
+            throw std::runtime_error("MmapAppendOnlyVec,TruncateFailed: " + file_name_ + ": " + strerror(errno));
+        }
+        header_->num_chunks.store(num_chunks, std::memory_order_release);
+        map_chunks();
+    }
+
+    void release() {
+        if (base_) munmap(base_, reserved_bytes_);
+        if (fd_ != -1) close(fd_);  // also releases the writer lock
+        base_ = nullptr;
+        fd_ = -1;
+    }
+
+    std::string file_name_;
+    char mode_;
+    int fd_ = -1;
+    size_t page_size_ = 0;
+    size_t reserved_bytes_ = 0;
+    size_t mapped_bytes_ = 0;
+    size_type capacity_ = 0;        // elements mapped
+    size_type write_capacity_ = 0;  // capacity_ for writers, 0 for readers so appending goes to grow() and throws
+    char* base_ = nullptr;
+    Header* header_ = nullptr;
+    T* data_ = nullptr;
+};
+
+/**
+ * ShmAppendOnlyVec: MmapAppendOnlyVec in a POSIX shared memory object, for one writer
+ * process distributing e.g. market data to reader processes on the same host, without
+ * copies nor syscalls per element.
+ *
+ *   // feed handler
+ *   wcc::ShmAppendOnlyVec<Tick, 8192> ticks("/md.ticks", 'w');
+ *   ticks.push_back(tick);
+ *
+ *   // strategy
+ *   wcc::ShmAppendOnlyVec<Tick, 8192> ticks("/md.ticks", 'r');
+ *   for (size_t n = ticks.size(); next < n; ++next) on_tick(ticks[next]);
+ *
+ * Readers attach by name and address elements by index, valid in every process whatever
+ * address the object is mapped at. The object outlives the processes until remove()d.
+ */
+template <typename T, size_t ChunkSize>
+class ShmAppendOnlyVec : public MmapAppendOnlyVec<T, ChunkSize> {
+public:
+    ShmAppendOnlyVec(std::string const& name, char mode = 'r', size_t max_bytes = size_t(1) << 40)
+        : MmapAppendOnlyVec<T, ChunkSize>(name, mode, max_bytes, true)
+    {}
+
+    // removes the name, processes attached keep their mapping
+    static void remove(std::string const& name) {
+        shm_unlink(name.c_str());
+    }
+};
+
+}  // namespace wcc
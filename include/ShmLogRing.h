@@ -0,0 +1,352 @@
+/**
+ * @file ShmLogRing.h
+ * @brief Per-process shared-memory log ring, its spdlog sink and the host-wide collector side.
+ *
+ * shm_ring_sink formats each message as any other sink and copies the text into fixed-size
+ * records of a ring mapped from <dir>/<name>.pid.<pid>.ring (dir defaults to /dev/shm), so
+ * the logging process does no file I/O. A message longer than one record spans several
+ * consecutive records. The writer never waits: when the collector falls behind and the
+ * ring is full, the message is dropped and counted in the ring header.
+ *
+ * ShmLogCollector (used by apps/log_collector) finds the rings of all processes in the
+ * directory, merges their messages by timestamp and removes a ring once its writer has
+ * exited and everything in it has been collected.
+ *
+ * File layout: one page of ShmLogRingHeader, then capacity records of ShmLogRecord.
+ * head (written by the logging process) and tail (written by the collector) are
+ * lock-free atomics shared across the two processes.
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>    // strerror
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <fmt/format.h>
+#include <spdlog/sinks/base_sink.h>
+
+namespace wcc {
+
+inline constexpr size_t k_shm_log_record_size = 256;
+
+struct ShmLogRecord {
+    int64_t time_ns;   // system_clock since epoch
+    uint16_t size;     // text bytes in this record
+    uint8_t level;     // spdlog::level numbering
+    uint8_t more;      // 1: the message continues in the next record
+    char text[k_shm_log_record_size - 12];
+};
+static_assert(sizeof(ShmLogRecord) == k_shm_log_record_size);
+
+struct ShmLogRingHeader {
+    constexpr static uint64_t k_magic = 0x3130474E49524C53;  // "SLRING01"
+    constexpr static uint32_t k_version = 1;
+    constexpr static size_t k_size = 4096;  // records start at this offset
+
+    std::atomic<uint64_t> magic;  // set last by the writer
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;            // records, power of 2
+    int64_t pid;
+    alignas(64) std::atomic<uint64_t> head;     // records published by the writer
+    std::atomic<uint64_t> dropped;              // messages dropped on a full ring
+    std::atomic<uint32_t> closed;               // the writer has exited cleanly
+    alignas(64) std::atomic<uint64_t> tail;     // records consumed by the collector
+};
+static_assert(sizeof(ShmLogRingHeader) <= ShmLogRingHeader::k_size);
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "head and tail are shared across processes");
+
+namespace internal {
+
+// Shared mapping of a ring file; the fd is closed once mapped
+class ShmLogMapping {
+public:
+    ShmLogMapping(std::string const& path, int fd, size_t size) : size_(size) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error(fmt::format("ShmLogRing,MmapFailed,{},{}", path, strerror(errno)));
+        addr_ = static_cast<char*>(p);
+    }
+
+    ShmLogMapping(ShmLogMapping&& other) noexcept : addr_(std::exchange(other.addr_, nullptr)), size_(other.size_) {}
+    ShmLogMapping& operator=(ShmLogMapping&&) = delete;
+
+    ~ShmLogMapping() { if (addr_) munmap(addr_, size_); }
+
+    ShmLogRingHeader* header() const { return reinterpret_cast<ShmLogRingHeader*>(addr_); }
+    ShmLogRecord* records() const { return reinterpret_cast<ShmLogRecord*>(addr_ + ShmLogRingHeader::k_size); }
+
+private:
+    char* addr_;
+    size_t size_;
+};
+
+} // namespace internal
+
+// Producer side, owned by the logging process; one thread at a time (the sink mutex)
+class ShmLogRingWriter {
+public:
+    ShmLogRingWriter(std::string path, size_t capacity)
+        : path_(std::move(path)), capacity_(std::bit_ceil(std::max<size_t>(capacity, 64))),
+          map_(open_file(path_, capacity_)) {
+        auto* hdr = map_.header();
+        hdr->version = ShmLogRingHeader::k_version;
+        hdr->record_size = k_shm_log_record_size;
+        hdr->capacity = capacity_;
+        hdr->pid = getpid();
+        hdr->magic.store(ShmLogRingHeader::k_magic, std::memory_order_release);
+    }
+
+    // The file stays for the collector, which removes it once drained
+    ~ShmLogRingWriter() { map_.header()->closed.store(1, std::memory_order_release); }
+
+    std::string const& path() const { return path_; }
+
+    uint64_t dropped() const { return map_.header()->dropped.load(std::memory_order_relaxed); }
+
+    // Returns false if the ring has no room for the whole message
+    bool write(int64_t time_ns, int level, std::string_view text) {
+        constexpr size_t payload = sizeof(ShmLogRecord::text);
+        auto* hdr = map_.header();
+        size_t n = std::max<size_t>(1, (text.size() + payload - 1) / payload);
+        uint64_t head = hdr->head.load(std::memory_order_relaxed);
+        if (head + n - cached_tail_ > capacity_) {
+            cached_tail_ = hdr->tail.load(std::memory_order_acquire);
+            if (head + n - cached_tail_ > capacity_) {
+                hdr->dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            auto& rec = map_.records()[(head + i) & (capacity_ - 1)];
+            auto part = text.substr(std::min(text.size(), i * payload), payload);
+            rec.time_ns = time_ns;
+            rec.size = static_cast<uint16_t>(part.size());
+            rec.level = static_cast<uint8_t>(level);
+            rec.more = i + 1 < n;
+            std::memcpy(rec.text, part.data(), part.size());
+        }
+        hdr->head.store(head + n, std::memory_order_release);  // all parts become visible at once
+        return true;
+    }
+
+private:
+    static internal::ShmLogMapping open_file(std::string const& path, size_t capacity) {
+        unlink(path.c_str());  // a stale ring of a previous process with the same pid
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        size_t size = ShmLogRingHeader::k_size + capacity * sizeof(ShmLogRecord);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            auto err = strerror(errno);
+            if (fd >= 0) close(fd);
+            throw std::runtime_error(fmt::format("ShmLogRingWriter,OpenFailed,{},{}", path, err));
+        }
+        return internal::ShmLogMapping(path, fd, size);
+    }
+
+    std::string path_;
+    size_t capacity_;
+    internal::ShmLogMapping map_;
+    uint64_t cached_tail_ = 0;
+};
+
+// Consumer side, used by the collector
+class ShmLogRingReader {
+public:
+    // Throws if path is not (yet) a complete ring
+    explicit ShmLogRingReader(std::string path) : path_(std::move(path)), map_(open_file(path_, inode_)) {
+        capacity_ = map_.header()->capacity;
+    }
+
+    std::string const& path() const { return path_; }
+    ino_t inode() const { return inode_; }
+    int64_t pid() const { return map_.header()->pid; }
+    uint64_t dropped() const { return map_.header()->dropped.load(std::memory_order_relaxed); }
+    bool closed() const { return map_.header()->closed.load(std::memory_order_acquire) != 0; }
+
+    bool empty() const {
+        return map_.header()->tail.load(std::memory_order_relaxed) ==
+               map_.header()->head.load(std::memory_order_acquire);
+    }
+
+    // First record of the oldest message, or nullptr if none is published
+    ShmLogRecord const* front() {
+        uint64_t tail = map_.header()->tail.load(std::memory_order_relaxed);
+        if (static_cast<int64_t>(cached_head_ - tail) <= 0) {
+            cached_head_ = map_.header()->head.load(std::memory_order_acquire);
+            if (cached_head_ == tail) return nullptr;
+        }
+        return &map_.records()[tail & (capacity_ - 1)];
+    }
+
+    // Append the text of the oldest message to out and release its records; front() must be non-null
+    void pop(std::string& out) {
+        uint64_t tail = map_.header()->tail.load(std::memory_order_relaxed);
+        for (bool more = true; more; ++tail) {
+            auto const& rec = map_.records()[tail & (capacity_ - 1)];
+            out.append(rec.text, rec.size);
+            more = rec.more;
+        }
+        map_.header()->tail.store(tail, std::memory_order_release);
+    }
+
+private:
+    static internal::ShmLogMapping open_file(std::string const& path, ino_t& inode) {
+        int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        struct stat st{};
+        if (fd < 0 || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < ShmLogRingHeader::k_size) {
+            if (fd >= 0) close(fd);
+            throw std::runtime_error(fmt::format("ShmLogRingReader,InvalidFile,{}", path));
+        }
+        inode = st.st_ino;
+        internal::ShmLogMapping map(path, fd, static_cast<size_t>(st.st_size));
+        auto* hdr = map.header();
+        if (hdr->magic.load(std::memory_order_acquire) != ShmLogRingHeader::k_magic ||
+            hdr->version != ShmLogRingHeader::k_version || hdr->record_size != k_shm_log_record_size ||
+            ShmLogRingHeader::k_size + hdr->capacity * sizeof(ShmLogRecord) != static_cast<size_t>(st.st_size))
+            throw std::runtime_error(fmt::format("ShmLogRingReader,InvalidFile,{}", path));
+        return map;
+    }
+
+    std::string path_;
+    ino_t inode_ = 0;
+    internal::ShmLogMapping map_;
+    size_t capacity_;
+    uint64_t cached_head_ = 0;
+};
+
+// Merges the rings <dir>/<name>.pid.*.ring of all processes on the host
+class ShmLogCollector {
+public:
+    // A message is held back until it is merge_delay old, so that slightly later writes of
+    // other processes with earlier timestamps are still merged in order
+    ShmLogCollector(std::string dir, std::string name, std::chrono::nanoseconds merge_delay)
+        : dir_(std::move(dir)), prefix_(std::move(name) + ".pid."), merge_delay_(merge_delay) {}
+
+    size_t rings() const { return rings_.size(); }
+
+    // Pick up new rings and remove the drained rings of exited processes
+    void scan() {
+        std::erase_if(rings_, [](Ring const& r) {
+            if (!r.reader->empty() || !(r.reader->closed() || !process_alive(r.reader->pid()))) return false;
+            struct stat st{};
+            if (stat(r.reader->path().c_str(), &st) == 0 && st.st_ino == r.reader->inode())
+                unlink(r.reader->path().c_str());
+            return true;
+        });
+
+        std::error_code ec;
+        for (auto const& entry : std::filesystem::directory_iterator(dir_, ec)) {
+            auto file = entry.path().filename().string();
+            if (!file.starts_with(prefix_) || !file.ends_with(".ring")) continue;
+            auto path = entry.path().string();
+            struct stat st{};
+            if (stat(path.c_str(), &st) != 0) continue;
+            if (std::any_of(rings_.begin(), rings_.end(), [&](Ring const& r) { return r.reader->inode() == st.st_ino; }))
+                continue;
+            try {
+                rings_.push_back(Ring{std::make_unique<ShmLogRingReader>(path), 0});
+            } catch (std::exception const&) {
+                // being created, retried at the next scan
+            }
+        }
+    }
+
+    // Append messages to out, oldest first, until max_bytes; all: ignore merge_delay (shutdown).
+    // Returns the number of messages appended
+    size_t collect(std::string& out, size_t max_bytes, bool all = false) {
+        report_dropped(out);
+        int64_t cutoff = all ? INT64_MAX : std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch() - merge_delay_).count();
+        size_t n = 0;
+        while (out.size() < max_bytes) {
+            Ring* best = nullptr;
+            ShmLogRecord const* best_rec = nullptr;
+            for (auto& r : rings_) {
+                auto const* rec = r.reader->front();
+                if (rec && (best_rec == nullptr || rec->time_ns < best_rec->time_ns)) {
+                    best = &r;
+                    best_rec = rec;
+                }
+            }
+            if (best == nullptr || best_rec->time_ns > cutoff) break;
+            best->reader->pop(out);
+            ++n;
+        }
+        return n;
+    }
+
+private:
+    struct Ring {
+        std::unique_ptr<ShmLogRingReader> reader;
+        uint64_t reported_dropped;
+    };
+
+    static bool process_alive(int64_t pid) {
+        return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+    }
+
+    void report_dropped(std::string& out) {
+        for (auto& r : rings_) {
+            if (uint64_t dropped = r.reader->dropped(); dropped != r.reported_dropped) {
+                fmt::format_to(std::back_inserter(out), "ShmLogCollector,Dropped,pid={},count={}\n",
+                               r.reader->pid(), dropped - r.reported_dropped);
+                r.reported_dropped = dropped;
+            }
+        }
+    }
+
+    std::string dir_;
+    std::string prefix_;
+    std::chrono::nanoseconds merge_delay_;
+    std::vector<Ring> rings_;
+};
+
+namespace sinks {
+
+// Sink writing the formatted messages into this process's shared-memory ring
+template <typename Mutex>
+class shm_ring_sink final : public spdlog::sinks::base_sink<Mutex> {
+public:
+    shm_ring_sink(std::string path, size_t capacity) : ring_(std::move(path), capacity) {}
+
+    std::string const& filename() const { return ring_.path(); }
+
+    uint64_t dropped() const { return ring_.dropped(); }
+
+protected:
+    void sink_it_(spdlog::details::log_msg const& msg) override {
+        spdlog::memory_buf_t formatted;
+        spdlog::sinks::base_sink<Mutex>::formatter_->format(msg, formatted);
+        ring_.write(std::chrono::duration_cast<std::chrono::nanoseconds>(msg.time.time_since_epoch()).count(),
+                    msg.level, std::string_view(formatted.data(), formatted.size()));
+    }
+
+    void flush_() override {}  // nothing buffered in this process
+
+private:
+    ShmLogRingWriter ring_;
+};
+
+using shm_ring_sink_mt = shm_ring_sink<std::mutex>;
+
+} // namespace sinks
+
+} // namespace wcc
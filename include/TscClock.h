@@ -0,0 +1,84 @@
+/**
+ * @file TscClock.h
+ * @brief Cheap timestamps from the CPU time stamp counter, converted to wall time later.
+ *
+ * TscClock::now() is a bare rdtsc (a few ns, no vDSO call, never steps backwards on an
+ * invariant-TSC machine). to_ns() maps ticks to CLOCK_REALTIME nanoseconds using a rate
+ * measured over the whole calibration history, anchored at the latest calibration point;
+ * call recalibrate() periodically (from one thread) to follow NTP adjustments.
+ * On non-x86 targets the ticks are CLOCK_MONOTONIC nanoseconds.
+ */
+
+#pragma once
+
+#include <time.h>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace wcc {
+
+class TscClock {
+public:
+    // Measures the tick rate over calibration_time; blocks that long
+    explicit TscClock(std::chrono::nanoseconds calibration_time = std::chrono::milliseconds(10)) {
+        first_ = sample();
+        std::this_thread::sleep_for(calibration_time);
+        recalibrate();
+    }
+
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+#endif
+    }
+
+    // Wall clock nanoseconds since epoch of a now() reading
+    int64_t to_ns(uint64_t tsc) const {
+        return base_.ns + static_cast<int64_t>(static_cast<double>(static_cast<int64_t>(tsc - base_.tsc)) * ns_per_tick_);
+    }
+
+    void recalibrate() {
+        base_ = sample();
+        if (base_.tsc != first_.tsc)
+            ns_per_tick_ = static_cast<double>(base_.ns - first_.ns) / static_cast<double>(base_.tsc - first_.tsc);
+    }
+
+    double ns_per_tick() const { return ns_per_tick_; }
+
+private:
+    struct Point {
+        uint64_t tsc;
+        int64_t ns;
+    };
+
+    // Realtime reading paired with the tsc at its middle; the tightest of a few tries
+    static Point sample() {
+        Point best{};
+        uint64_t best_gap = UINT64_MAX;
+        for (int i = 0; i < 5; ++i) {
+            timespec ts;
+            uint64_t t0 = now();
+            clock_gettime(CLOCK_REALTIME, &ts);
+            uint64_t t1 = now();
+            if (t1 - t0 < best_gap) {
+                best_gap = t1 - t0;
+                best = {t0 + (t1 - t0) / 2, int64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec};
+            }
+        }
+        return best;
+    }
+
+    Point first_;
+    Point base_{};
+    double ns_per_tick_ = 1.0;
+};
+
+} // namespace wcc
@@ -3,7 +3,10 @@
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include "AppendOnlyVec.h"
 #include <thread>
+#include <deque>
+#include <list>
 #include <chrono>
+#include <numeric>
 
 YAML::Node cfg = YAML::Load(R"(
     default_format : "[%-8l] [%-12n] %v"
@@ -126,6 +129,250 @@ TEST_CASE("AppendOnlyVec", "[AppendOnlyVec]") {
             std::jthread(run, 10000000);
         }
     }
+
+    SECTION("Single writer multiple readers") {
+        using SpVec = wcc::AppendOnlyVec<uint64_t, CHUNK_SIZE>;
+        SpVec::config(NUM_CHUNKS);
+        constexpr uint64_t N = 1 << 20;
+
+        SpVec vec;
+        std::atomic_bool failed = false;
+        auto read = [&]() {
+            for (uint64_t n = 0; n < N; ) {
+                n = vec.size();  // acquire published size
+                if (n == 0) continue;
+                if (vec[n - 1] != n - 1 || vec[n / 2] != n / 2) failed = true;
+            }
+        };
+        std::vector<std::jthread> readers;
+        for (int i = 0; i < 3; ++i) readers.emplace_back(read);
+        for (uint64_t i = 0; i < N; ++i) vec.push_back(i);
+        readers.clear();  // join
+
+        REQUIRE(!failed);
+        REQUIRE(vec.size() == N);
+        REQUIRE(vec.capacity() >= N);
+    }
+
+    SECTION("Non trivial elements and clear") {
+        using StrVec = wcc::AppendOnlyVec<std::string, CHUNK_SIZE>;
+        StrVec::config(2);
+
+        StrVec vec;
+        for (int i = 0; i < 10; ++i) vec.emplace_back(40, char('a' + i));  // long enough to allocate
+        REQUIRE(vec.size() == 10);
+        REQUIRE(vec[9] == std::string(40, 'j'));
+        REQUIRE(reinterpret_cast<uintptr_t>(&vec[0]) % 64 == 0);       // chunks are cache line aligned
+        REQUIRE(reinterpret_cast<uintptr_t>(&vec[CHUNK_SIZE]) % 64 == 0);
+
+        auto n_in_use = StrVec::num_chunks_in_use();
+        vec.clear();  // destroys strings, keeps chunks
+        REQUIRE(vec.empty());
+        REQUIRE(StrVec::num_chunks_in_use() == n_in_use);
+        for (int i = 0; i < 5; ++i) vec.emplace_back("x");
+        REQUIRE(vec.size() == 5);
+        REQUIRE(vec[4] == "x");
+        REQUIRE(StrVec::num_chunks_in_use() == n_in_use);
+    }
+
+    SECTION("Injected storage") {
+        using OwnVec = wcc::AppendOnlyVec<double, CHUNK_SIZE>;  // never config'ed
+        REQUIRE_THROWS_AS(OwnVec(), std::logic_error);
+        REQUIRE_THROWS_AS(OwnVec::num_chunks_in_use(), std::logic_error);
+        REQUIRE_THROWS_AS(OwnVec::water_mark(), std::logic_error);
+        REQUIRE_THROWS_AS(OwnVec::stats(), std::logic_error);
+        REQUIRE_THROWS_AS(OwnVec(nullptr), std::invalid_argument);
+
+        auto storage = std::make_shared<OwnVec::storage_type>(wcc::ChunkStorageOptions{
+            .n_chunks = 4, .numa_node = 0, .huge_pages = true, .prefault = true, .prefault_cpu = 0,
+            .name = "injected", .log_stats = true});
+        REQUIRE(storage->num_chunks_allocated() == 4);
+        {
+            OwnVec a(storage), b(storage);
+            for (int i = 0; i < 10; ++i) a.push_back(i);
+            for (int i = 0; i < 10; ++i) b.push_back(-i);
+            REQUIRE(storage->num_chunks_in_use() == 6);
+            REQUIRE(storage->num_chunks_allocated() >= 6);  // more mapped on demand
+            REQUIRE(a[9] == 9);
+            REQUIRE(b[9] == -9);
+
+            OwnVec c(std::move(a));
+            REQUIRE(c.storage() == storage);
+            REQUIRE(a.storage() == storage);  // moved-from vector stays usable
+            a.push_back(1);
+            REQUIRE(storage->num_chunks_in_use() == 7);
+        }
+        REQUIRE(storage->num_chunks_in_use() == 0);
+        REQUIRE(storage->water_mark() == 7);
+
+        auto st = storage->stats();
+        REQUIRE(st.num_chunks_in_use == 0);
+        REQUIRE(st.water_mark == 7);
+        REQUIRE(st.num_chunks_allocated == storage->num_chunks_allocated());
+        REQUIRE(st.pool_hits + st.fallback_allocations == 7);
+        REQUIRE(st.fallback_allocations >= 1);  // only 4 chunks preallocated
+        REQUIRE(std::accumulate(st.new_chunk_latency.begin(), st.new_chunk_latency.end(), uint64_t(0)) == 7);
+        REQUIRE(st.to_string().find("water_mark=7") != std::string::npos);
+    }
+
+    SECTION("Bulk append") {
+        using BVec = wcc::AppendOnlyVec<int, CHUNK_SIZE>;
+        auto storage = std::make_shared<BVec::storage_type>(NUM_CHUNKS);
+        BVec vec(storage);
+
+        std::vector<int> src(10);
+        for (int i = 0; i < 10; ++i) src[i] = i;
+        vec.push_back(-1);                           // start in the middle of a chunk
+        vec.append(src);                             // memcpy, spans 3 chunks
+        std::list<int> lst{10, 11, 12};
+        vec.append_range(lst.begin(), lst.end());    // one by one
+        std::deque<int> deq{13, 14, 15, 16, 17};
+        vec.append_range(deq.begin(), deq.end());    // chunk by chunk copy
+        REQUIRE(vec.size() == 19);
+        REQUIRE(vec[0] == -1);
+        for (int i = 0; i < 18; ++i) REQUIRE(vec[i + 1] == i);
+
+        auto s = vec.emplace_n(100);                 // only the rest of current chunk
+        REQUIRE(s.size() == 1);
+        s[0] = 18;
+        s = vec.emplace_n(100);                      // a full new chunk
+        REQUIRE(s.size() == CHUNK_SIZE);
+        for (auto& x : s) x = 42;
+        REQUIRE(vec.size() == 20 + CHUNK_SIZE);
+        REQUIRE(vec[19] == 18);
+        REQUIRE(vec.back() == 42);
+        REQUIRE(vec.emplace_n(0).empty());
+    }
+
+    SECTION("Chunks and segmented algorithms") {
+        using BVec = wcc::AppendOnlyVec<int, CHUNK_SIZE>;
+        BVec vec(std::make_shared<BVec::storage_type>(NUM_CHUNKS));
+        auto const& cvec = vec;
+        REQUIRE(vec.chunks().empty());
+        REQUIRE(wcc::lower_bound(cvec, 0) == cvec.end());
+
+        for (int i = 0; i < 10; ++i) vec.push_back(2 * i);  // 0, 2, ..., 18
+        auto chunks = vec.chunks();
+        REQUIRE(chunks.size() == 3);
+        std::vector<size_t> sizes;
+        for (std::span<int> s : chunks) sizes.push_back(s.size());
+        REQUIRE(sizes == std::vector<size_t>{CHUNK_SIZE, CHUNK_SIZE, 2});
+        REQUIRE(chunks[2][1] == 18);
+
+        int sum = 0;
+        wcc::for_each(vec, [&sum](int x) { sum += x; });
+        REQUIRE(sum == 90);
+        wcc::for_each(vec, [](int& x) { x += 1; });  // 1, 3, ..., 19
+        REQUIRE(wcc::transform_reduce(cvec, 0L, std::plus<>(), [](int x) { return long(x) * x; }) == 1330);
+
+        REQUIRE(wcc::lower_bound(cvec, 0) - cvec.begin() == 0);
+        REQUIRE(wcc::lower_bound(cvec, 7) - cvec.begin() == 3);   // first chunk
+        REQUIRE(wcc::lower_bound(cvec, 8) - cvec.begin() == 4);   // start of second chunk
+        REQUIRE(wcc::lower_bound(cvec, 19) - cvec.begin() == 9);  // last one
+        REQUIRE(wcc::lower_bound(cvec, 20) == cvec.end());
+    }
+
+    SECTION("Rolling window by retiring chunks") {
+        using RVec = wcc::AppendOnlyVec<std::string, CHUNK_SIZE>;
+        auto storage = std::make_shared<RVec::storage_type>(NUM_CHUNKS);
+        RVec vec(storage);
+        for (int i = 0; i < 100; ++i) vec.push_back(std::to_string(i));
+
+        REQUIRE(vec.retire_until(90) == 88);  // whole chunks only
+        REQUIRE(vec.oldest_index() == 88);
+        REQUIRE(vec.size() == 100);            // indices are stable
+        REQUIRE(vec[88] == "88");
+        REQUIRE(vec.front() == "88");
+        REQUIRE(*vec.begin() == "88");
+        REQUIRE(vec.end() - vec.begin() == 12);
+        REQUIRE(storage->num_chunks_in_use() == 3);
+        REQUIRE(vec.chunks().size() == 3);
+        REQUIRE(vec.chunks()[0][0] == "88");
+
+        {
+            auto guard = vec.read_guard();     // retired chunks wait for the reader
+            REQUIRE(vec.retire_until(96) == 96);
+            REQUIRE(storage->num_chunks_in_use() == 3);
+            REQUIRE(vec[96] == "96");
+        }
+        vec.reclaim();
+        REQUIRE(storage->num_chunks_in_use() == 1);
+
+        // constant memory over a long run
+        for (int i = 100; i < 100000; ++i) {
+            vec.push_back(std::to_string(i));
+            if (i % 50 == 0) vec.retire_until(vec.size() - 20);
+        }
+        REQUIRE(vec.capacity() <= 32 * CHUNK_SIZE);
+        REQUIRE(storage->num_chunks_in_use() <= 20);
+        REQUIRE(vec.back() == "99999");
+
+        vec.clear();
+        REQUIRE(vec.oldest_index() == 0);
+        vec.push_back("0");
+        REQUIRE(vec[0] == "0");
+    }
+
+    SECTION("Rolling window with concurrent readers") {
+        using RVec = wcc::AppendOnlyVec<uint64_t, CHUNK_SIZE>;
+        auto storage = std::make_shared<RVec::storage_type>(NUM_CHUNKS);
+        RVec vec(storage);
+        constexpr uint64_t N = 1 << 18;
+
+        std::atomic_bool failed = false;
+        auto read = [&]() {
+            for (uint64_t n = 0; n < N; ) {
+                auto guard = vec.read_guard();
+                n = vec.size();
+                for (uint64_t i = vec.oldest_index(); i < n; i += 7) {
+                    if (vec[i] != i) failed = true;
+                }
+            }
+        };
+        std::vector<std::jthread> readers;
+        for (int i = 0; i < 3; ++i) readers.emplace_back(read);
+        for (uint64_t i = 0; i < N; ++i) {
+            vec.push_back(i);
+            if (i % 64 == 0) vec.retire_until(i / 2);
+        }
+        readers.clear();  // join
+
+        REQUIRE(!failed);
+        vec.retire_until(N / 2);  // no reader left, reclaimed at once
+        REQUIRE(storage->num_chunks_in_use() == N / 2 / CHUNK_SIZE);
+    }
+
+    SECTION("Chunks taken and returned concurrently") {
+        using CcVec = wcc::AppendOnlyVec<int16_t, CHUNK_SIZE>;
+        CcVec::config(8);  // fewer than needed, so threads race on both the free list and fallback allocation
+
+        std::atomic_bool failed = false;  // REQUIRE is not thread safe
+        auto run = [&failed](int rounds) {
+            for (int r = 0; r < rounds; ++r) {
+                CcVec vec;
+                for (size_t i = 0; i < 3 * CHUNK_SIZE; ++i) vec.push_back(int16_t(i));
+                for (size_t i = 0; i < 3 * CHUNK_SIZE; i += CHUNK_SIZE / 2) {
+                    if (vec[i] != int16_t(i)) failed = true;
+                }
+            }
+        };
+        {
+            std::vector<CcVec> held(6);  // 18 chunks in use: the pool doubles 8 -> 16 -> 32
+            for (auto& vec : held) {
+                for (size_t i = 0; i < 3 * CHUNK_SIZE; ++i) vec.push_back(int16_t(i));
+            }
+            REQUIRE(CcVec::num_chunks_in_use() == 18);
+            REQUIRE(CcVec::num_chunks_allocated() == 32);
+        }
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < 8; ++i) threads.emplace_back(run, 200);
+        }
+        REQUIRE(!failed);
+        REQUIRE(CcVec::num_chunks_in_use() == 0);
+        REQUIRE(CcVec::water_mark() <= CcVec::num_chunks_allocated());
+        REQUIRE(CcVec::num_chunks_allocated() <= 32);  // 8 doubled until it covers the 8 * 3 in use at most
+    }
 }  // TEST_CASE
 
 
@@ -0,0 +1,168 @@
+/*
+* DeferredLogTest.cpp
+*
+* This file contains tests for the deferred-formatting backend of LogConfig.
+* Log calls only queue raw arguments, so every check flushes before reading the log.
+*/
+
+#include "LogConfig.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Trivially copyable but user defined, so it may point elsewhere: formatted on the calling thread
+struct Quote {
+    int64_t time;
+    double price;
+};
+
+// Not trivially copyable: formatted on the calling thread
+struct Named {
+    std::string name;
+};
+
+// Refers to memory of the caller
+struct View {
+    std::string_view name;
+};
+
+template <> struct fmt::formatter<Quote> {
+    constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+    template <typename FormatContext>
+    auto format(Quote const& q, FormatContext& ctx) const { return fmt::format_to(ctx.out(), "{}@{}", q.price, q.time); }
+};
+
+template <> struct fmt::formatter<Named> {
+    constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+    template <typename FormatContext>
+    auto format(Named const& n, FormatContext& ctx) const { return fmt::format_to(ctx.out(), "<{}>", n.name); }
+};
+
+template <> struct fmt::formatter<View> {
+    constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+    template <typename FormatContext>
+    auto format(View const& v, FormatContext& ctx) const { return fmt::format_to(ctx.out(), "<{}>", v.name); }
+};
+
+struct Logged : wcc::AttachLogger<"Test"> {
+    void run(int x) { log_info("x:{}", x); }
+};
+
+TEST_CASE("DeferredLog", "[LogConfig]") {
+   YAML::Node cfg = YAML::Load(R"(
+       default_format : "[%-8l] [%-12n] %v"
+       default_level : "info"
+       default_log_dir : "log"
+       default_log_prefix: "test"
+       backend: deferred
+       deferred_queue_size: 4096
+       deferred_overflow: block
+       sinks:
+       - string
+       loggers:
+       - main
+       - Test
+       set_error_loggers:
+       set_debug_loggers:
+   )");
+
+   wcc::config_log(cfg);
+
+   SECTION("Argument types") {
+       std::string_view sv = "view";
+       const char* cstr = "cstr";
+       wcc::log_debug("not {}", "shown");
+       wcc::log_info("pi = {:.4f}", 3.1415926);
+       wcc::log_info("{:06d} is {}", 5, std::string("SZ stock"));  // temporary copied before return
+       wcc::log_warn("{}|{:>6}|{:.2s}", cstr, sv, "hello");
+       wcc::log_error("quote {}", Quote{93000000, 10.5});
+       wcc::log_critical("named {}", Named{"eager"});
+       Logged{}.run(1);
+       wcc::log_flush_all();
+       REQUIRE(wcc::get_logger_str() ==
+            "[info    ] [main        ] pi = 3.1416\n"
+            "[info    ] [main        ] 000005 is SZ stock\n"
+            "[warning ] [main        ] cstr|  view|he\n"
+            "[error   ] [main        ] quote 10.5@93000000\n"
+            "[critical] [main        ] named <eager>\n"
+            "[info    ] [Test        ] x:1\n"
+       );
+   }
+
+   SECTION("Caller memory changed after the call") {
+       std::string name = "before";
+       std::vector<int> values{1, 2, 3};
+       {
+           std::string fmt_str = "runtime {} {}";
+           wcc::log_info(fmt::runtime(fmt_str), View{name}, fmt::join(values, ","));
+           wcc::log_info(fmt::runtime(fmt_str), 7, "deferred");  // deferred args, copied format text
+           fmt_str.assign("overwritten format string");
+       }
+       name.assign("after!");
+       values.assign({9, 9, 9});  // same storage
+       wcc::log_flush();
+       REQUIRE(wcc::get_logger_str() ==
+            "[info    ] [main        ] runtime <before> 1,2,3\n"
+            "[info    ] [main        ] runtime 7 deferred\n");
+   }
+
+   SECTION("Ring wrap and oversized records") {
+       // 4096-byte rings: wrap many times, and a record larger than half a ring is logged directly
+       for (int i = 0; i < 1000; ++i) wcc::log_info("{}", i);
+       wcc::log_info("{}", std::string(3000, 'x'));
+       wcc::log_flush();
+       auto str = wcc::get_logger_str();
+       REQUIRE(std::count(str.begin(), str.end(), '\n') == 1001);
+       REQUIRE(str.starts_with("[info    ] [main        ] 0\n"));
+       REQUIRE(str.find("[info    ] [main        ] 999\n[info    ] [main        ] xxx") != std::string::npos);
+   }
+
+   SECTION("Many threads") {
+       constexpr int N = 2000;
+       {
+           std::vector<std::jthread> threads;
+           for (int t = 0; t < 4; ++t) {
+               threads.emplace_back([t] {
+                   for (int i = 0; i < N; ++i) wcc::log_info("t{} {}", t, i);
+               });
+           }
+       }
+       wcc::log_flush();
+       auto str = wcc::get_logger_str();
+       REQUIRE(std::count(str.begin(), str.end(), '\n') == 4 * N);
+       for (int t = 0; t < 4; ++t) {  // per-thread order is kept
+           REQUIRE(str.find(fmt::format("t{} {}\n", t, N - 2)) < str.find(fmt::format("t{} {}\n", t, N - 1)));
+       }
+   }
+
+   SECTION("Flush while other threads keep logging") {
+       std::atomic<bool> stop{false};
+       std::jthread busy([&stop] {
+           while (!stop.load()) wcc::log_info("busy");
+       });
+       for (int i = 0; i < 20; ++i) {
+           wcc::log_info("mine {}", i);
+           wcc::log_flush();  // waits for what was queued before, not for an empty backend
+       }
+       wcc::log_info("{}", std::string(3000, 'x'));  // oversized: waits for this thread's ring only
+       stop.store(true);
+       busy.join();
+       wcc::log_flush();
+       auto str = wcc::get_logger_str();
+       REQUIRE(str.find("mine 19\n") < str.find("xxx"));
+   }
+
+   SECTION("Benchmark") {
+       BENCHMARK("deferred log") {
+           wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+           wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+           wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+       };
+       wcc::log_flush();
+       wcc::get_logger_str();
+   }
+}
@@ -0,0 +1,151 @@
+/*
+* EventLogTest.cpp
+*
+* This file contains tests for the structured event log written by the HJ macros.
+*/
+
+#include "LogConfig.h"
+#include "HJLogFormat.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+struct Trader : wcc::AttachLogger<"Test"> {
+    int trader_id() const { return 7; }
+
+    void on_fill(double price, int qty) {
+        ID_MLOG(info, "fill", VAR(price), VAR(qty), ("side:{}", 'B'));
+    }
+};
+
+TEST_CASE("EventLog", "[LogConfig]") {
+   YAML::Node cfg = YAML::Load(R"(
+       default_format : "[%-8l] [%-12n] %v"
+       default_level : "info"
+       default_log_dir : "log"
+       default_log_prefix: "EventLogTest"
+       event_log: true
+       sinks:
+       - string
+       loggers:
+       - main
+       - Test
+       set_error_loggers:
+       set_debug_loggers:
+   )");
+
+   wcc::config_log(cfg);
+   std::string path = "log/EventLogTest.pid." + std::to_string(getpid()) + ".evt";
+
+   SECTION("Typed fields next to the text line") {
+       std::string sym = "000001";
+       uint64_t vol = 300;
+       bool ok = true;
+       LOG(info, "order", VAR(sym), VAR("06d", vol), ("{}", ok), (-5));
+       LOG(debug, "hidden", VAR(vol));  // below the logger level: no record either
+       Trader{}.on_fill(10.5, 200);
+       wcc::log_flush_all();
+       REQUIRE(wcc::get_logger_str().find("{sym:000001,vol:000300,true,-5}") != std::string::npos);
+
+       wcc::EventLogReader reader(path);
+       wcc::Event ev;
+       REQUIRE(reader.next(ev));
+       REQUIRE(ev.level == spdlog::level::info);
+       REQUIRE(ev.logger == "main");
+       REQUIRE(ev.event == "order");
+       REQUIRE_FALSE(ev.trader_id);
+       REQUIRE(ev.fields.size() == 4);
+       REQUIRE(ev.fields[0].name == "sym");
+       REQUIRE(std::get<std::string>(ev.fields[0].value) == "000001");
+       REQUIRE(ev.fields[1].name == "vol");
+       REQUIRE(std::get<uint64_t>(ev.fields[1].value) == 300);  // stored as a number, not as "000300"
+       REQUIRE(ev.fields[2].name.empty());
+       REQUIRE(std::get<bool>(ev.fields[2].value));
+       REQUIRE(std::get<int64_t>(ev.fields[3].value) == -5);
+
+       REQUIRE(reader.next(ev));
+       REQUIRE(ev.logger == "Test");
+       REQUIRE(ev.function == "on_fill");
+       REQUIRE(std::get<int64_t>(ev.trader_id->value) == 7);
+       auto json = wcc::to_json(ev);
+       REQUIRE(json.ends_with(R"("function":"on_fill","event":"fill","trader_id":7,)"
+                              R"("fields":{"price":10.5,"qty":200,"side":"B"}})"));
+       REQUIRE_FALSE(reader.next(ev));
+   }
+
+   SECTION("Records of several threads") {
+       constexpr int n_threads = 4, n_records = 1000;
+       std::vector<std::jthread> threads;
+       for (int t = 0; t < n_threads; ++t) {
+           threads.emplace_back([t] {
+               for (int i = 0; i < n_records; ++i) LOG(info, "tick", VAR(t), VAR(i));
+           });
+       }
+       threads.clear();  // joins; the records of exited threads are still written
+       wcc::log_flush_all();
+
+       wcc::EventLogReader reader(path);
+       wcc::Event ev;
+       std::vector<int64_t> next(n_threads, 0);
+       while (reader.next(ev)) {
+           if (ev.event != "tick") continue;
+           auto t = std::get<int64_t>(ev.fields[0].value);
+           REQUIRE(std::get<int64_t>(ev.fields[1].value) == next[t]++);  // in order within a thread
+       }
+       REQUIRE(next == std::vector<int64_t>(n_threads, n_records));
+   }
+
+   SECTION("Non-finite values as JSON") {
+       wcc::Event ev;
+       ev.fields = {{"nan", std::numeric_limits<double>::quiet_NaN()},
+                    {"inf", -std::numeric_limits<double>::infinity()}, {"x", 1.5}};
+       REQUIRE(wcc::to_json(ev).ends_with(R"("fields":{"nan":null,"inf":null,"x":1.5}})"));
+   }
+
+   SECTION("Truncated and corrupt files") {
+       std::string sym = "000001";
+       LOG(info, "order", VAR(sym));
+       wcc::log_flush_all();
+       std::ifstream in(path, std::ios::binary);
+       std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+       REQUIRE(data.size() > 20);
+       auto read_all = [](std::string const& bytes) {
+           {
+               std::ofstream out("log/EventLogTest.bad.evt", std::ios::binary);
+               out << bytes;
+           }
+           wcc::EventLogReader reader("log/EventLogTest.bad.evt");
+           wcc::Event ev;
+           size_t n = 0;
+           while (reader.next(ev)) ++n;
+           return n;
+       };
+       size_t n = read_all(data);
+       REQUIRE(n > 0);
+       REQUIRE(read_all(data.substr(0, data.size() - 3)) == n - 1);  // truncated last record
+
+       std::string bad = data;
+       uint32_t size = 0xfffffff0;  // first record size
+       std::memcpy(bad.data() + 8, &size, sizeof(size));
+       REQUIRE_THROWS_AS(read_all(bad), std::runtime_error);
+
+       bad = data;
+       uint32_t first;
+       std::memcpy(&first, bad.data() + 8, sizeof(first));
+       first -= 4;  // record claims fewer bytes than its fields use
+       std::memcpy(bad.data() + 8, &first, sizeof(first));
+       REQUIRE_THROWS_AS(read_all(bad), std::runtime_error);
+   }
+
+   SECTION("Field names from format strings") {
+       static_assert(wcc::internal::event_field_name("price:{:.2f}") == "price");
+       static_assert(wcc::internal::event_field_name("{}").empty());
+       static_assert(wcc::internal::event_field_name("a b:{}").empty());
+       REQUIRE_THROWS_AS(wcc::EventLogReader("no_such_file.evt"), std::runtime_error);
+   }
+}
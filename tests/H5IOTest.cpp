@@ -6,12 +6,28 @@
 #include "H5IO.h"
 #include <vector>
 #include <list>
+#include <deque>
+#include <array>
+#include <span>
 #include <fmt/format.h>
 #include <unistd.h>
 #include <catch2/catch_test_macros.hpp>
 
 using namespace wcc;
 
+// Container filled by block appends only, like AppendOnlyVec::append(span)
+struct BlockAppendVec {
+    using value_type = double;
+    std::vector<double> data;
+    std::size_t n_appends = 0;
+
+    void clear() { data.clear(); }
+    void append(std::span<const double> block) {
+        data.insert(data.end(), block.begin(), block.end());
+        ++n_appends;
+    }
+};
+
 TEST_CASE("H5IOTest", "[WCCommon]") {
     std::string filename = "H5IOTestData.h5";
     SECTION("file create") {
@@ -172,4 +188,217 @@ TEST_CASE("H5IOTest", "[WCCommon]") {
         }
         unlink(filename.c_str());
     }
+    SECTION("read - default init vector") {
+        constexpr std::size_t k_len = 16UL<<10; // 16k
+        std::vector<double> darray(k_len, 0);
+        for(std::size_t i = 0; i < k_len; ++i) {
+            darray[i] = i * 0.5;
+        }
+        {
+            H5File h5_file(filename, 'w');
+            h5_write_vector(h5_file.id(), "/d_dataset", darray);
+        } {
+            H5File h5_file(filename, 'r');
+            std::vector<double, DefaultInitAllocator<double>> darray_load(3, 1.0);
+            h5_read_vector(h5_file.id(), "/d_dataset", darray_load);
+            REQUIRE(darray_load.size() == darray.size());
+            REQUIRE(std::equal(darray_load.begin(), darray_load.end(), darray.begin()));
+        }
+        unlink(filename.c_str());
+    }
+    SECTION("read - fixed size range") {
+        std::vector<int> iarray{1,1,2,3,5,8,11,13};
+        {
+            H5File h5_file(filename, 'w');
+            h5_write_vector(h5_file.id(), "/i_dataset", iarray);
+        } {
+            H5File h5_file(filename, 'r');
+            std::array<int, 8> iarray_load{};
+            h5_read_vector(h5_file.id(), "/i_dataset", iarray_load);
+            REQUIRE(std::equal(iarray_load.begin(), iarray_load.end(), iarray.begin()));
+
+            std::vector<int> storage(8, 0);
+            std::span<int> ispan(storage);
+            h5_read_vector(h5_file.id(), "/i_dataset", ispan);
+            REQUIRE(storage == iarray);
+
+            std::array<int, 4> too_short{};
+            REQUIRE_THROWS(h5_read_vector(h5_file.id(), "/i_dataset", too_short));
+        }
+        unlink(filename.c_str());
+    }
+    SECTION("read - deque by blocks") {
+        constexpr std::size_t k_len = (1UL<<18) + 3; // more than one 1M read block of doubles
+        std::vector<double> darray(k_len, 0);
+        for(std::size_t i = 0; i < k_len; ++i) {
+            darray[i] = i % 1024;
+        }
+        {
+            H5File h5_file(filename, 'w');
+            h5_write_vector(h5_file.id(), "/d_dataset", darray);
+        } {
+            H5File h5_file(filename, 'r');
+            std::deque<double> ddeque_load{1.0, 2.0};
+            h5_read_vector(h5_file.id(), "/d_dataset", ddeque_load);
+            REQUIRE(ddeque_load.size() == darray.size());
+            REQUIRE(std::equal(ddeque_load.begin(), ddeque_load.end(), darray.begin()));
+
+            BlockAppendVec dvec_load;
+            h5_read_vector(h5_file, "/d_dataset", dvec_load);  // appended in bulk
+            REQUIRE(dvec_load.n_appends == 3);  // two full 1M blocks and the 3 rows left
+            REQUIRE(dvec_load.data == darray);
+        }
+        unlink(filename.c_str());
+    }
+    SECTION("handles - raii and cache") {
+        std::vector<double> darray{1.1,1.1,2.1,3.1,5.1,8.1,11.1,13.1};
+        std::vector<int   > iarray{1,1,2,3,5,8,11,13};
+        {
+            H5File h5_file(filename, 'w');
+            H5Group group = h5_require_group(h5_file.id(), "Data");
+            REQUIRE(static_cast<bool>(group));
+            h5_write_vector(group.id(), "d_dataset", darray);
+            h5_write_vector(group.id(), "i_dataset", iarray);
+        } {
+            H5File h5_file(filename, 'r');
+            REQUIRE(h5_file.num_cached() == 0);
+            std::vector<double> darray_load;
+            std::vector<int   > iarray_load;
+            h5_read_vector(h5_file, "/Data/d_dataset", darray_load);
+            h5_read_vector(h5_file, "/Data/i_dataset", iarray_load);
+            REQUIRE(darray_load == darray);
+            REQUIRE(iarray_load == iarray);
+            REQUIRE(h5_file.num_cached() == 2);
+
+            // repeated reads reuse the cached handle
+            hid_t dataset_id = h5_file.dataset("/Data/d_dataset");
+            auto dims = h5_query_dataset_dim(h5_file, "/Data/d_dataset");
+            REQUIRE(dims.size() == 1);
+            REQUIRE(dims[0] == darray.size());
+            REQUIRE(h5_file.dataset("/Data/d_dataset") == dataset_id);
+            REQUIRE(h5_file.num_cached() == 2);
+
+            auto objs = h5_scan_path_object(h5_file, "/Data");
+            REQUIRE(objs.size() == 2);
+            REQUIRE(h5_file.num_cached() == 3);
+
+            h5_file.close_cached();
+            REQUIRE(h5_file.num_cached() == 0);
+            REQUIRE_THROWS(h5_file.dataset("/Data/missing"));
+        }
+        unlink(filename.c_str());
+    }
+    SECTION("file options") {
+        constexpr std::size_t k_len = 16UL<<10; // 16k
+        std::vector<double> darray(k_len, 0);
+        for(std::size_t i = 0; i < k_len; ++i) {
+            darray[i] = i % 1024;
+        }
+        H5FileOptions options;
+        options.chunk_cache_bytes = 64UL<<20;
+        options.chunk_cache_slots = 12421;
+        options.chunk_cache_w0 = 1.0;
+        options.metadata_cache_bytes = 8UL<<20;
+        options.page_buffer_bytes = 1UL<<20;
+        options.latest_format = true;
+        {
+            H5File h5_file(filename, 'w', options);
+            h5_write_vector(h5_file.id(), "/compressed", darray, true);
+        } {
+            H5File h5_file(filename, 'r', options);
+            std::vector<double> darray_load;
+            h5_read_vector(h5_file, "/compressed", darray_load);
+            REQUIRE(darray_load == darray);
+        } {
+            H5FileOptions core_options;
+            core_options.core_driver = true;
+            H5File h5_file(filename, 'r', core_options);
+            std::vector<double> darray_load;
+            h5_read_vector(h5_file, "/compressed", darray_load);
+            REQUIRE(darray_load == darray);
+        }
+        unlink(filename.c_str());
+    }
+    SECTION("strings - fixed length") {
+        std::vector<FixedString<8>> codes{"600000", "000001", "IF2406", "12345678"};
+        std::list<std::array<char, 4>> exchanges{{'S','S','E','\0'}, {'S','Z','S','E'}};
+        {
+            H5File h5_file(filename, 'w');
+            h5_write_vector(h5_file.id(), "/code", codes);
+            h5_write_vector(h5_file.id(), "/exchange", exchanges);
+        } {
+            H5File h5_file(filename, 'r');
+            std::vector<FixedString<8>, DefaultInitAllocator<FixedString<8>>> codes_load;
+            h5_read_vector(h5_file, "/code", codes_load);
+            REQUIRE(codes_load.size() == codes.size());
+            REQUIRE(codes_load[0] == "600000");
+            REQUIRE(codes_load[2] == "IF2406");
+            REQUIRE(codes_load[3] == "12345678");
+            REQUIRE(codes_load[3].size() == 8);
+            REQUIRE(codes_load[1] == codes[1]);
+
+            std::list<std::array<char, 4>> exchanges_load;
+            h5_read_vector(h5_file, "/exchange", exchanges_load);
+            REQUIRE(exchanges_load == exchanges);
+        }
+        unlink(filename.c_str());
+    }
+    SECTION("strings - variable length") {
+        std::vector<std::string> names{"Shanghai Pudong Development Bank", "", "Ping An Bank"};
+        std::list<std::string> name_list(names.begin(), names.end());
+        {
+            H5File h5_file(filename, 'w');
+            h5_write_vector(h5_file.id(), "/name", names);
+            h5_write_vector(h5_file.id(), "/name_list", name_list);
+        } {
+            H5File h5_file(filename, 'r');
+            std::vector<std::string> names_load;
+            h5_read_vector(h5_file, "/name", names_load);
+            REQUIRE(names_load == names);
+
+            std::list<std::string> name_list_load;
+            h5_read_vector(h5_file, "/name_list", name_list_load);
+            REQUIRE(name_list_load == name_list);
+        }
+        unlink(filename.c_str());
+    }
+    SECTION("element count - no int overflow") {
+        REQUIRE(_h5_count_elements({3UL<<30}) == (3UL<<30));
+        REQUIRE(_h5_count_elements({1UL<<32, 2}) == (1UL<<33));
+    }
+    SECTION("matrix - write and read") {
+        constexpr std::size_t k_rows = 4096, k_cols = 5; // 20k elements, chunked and compressed
+        std::vector<double> factors(k_rows * k_cols);
+        for(std::size_t i = 0; i < factors.size(); ++i) {
+            factors[i] = i * 0.25;
+        }
+        std::vector<int> small{1,2,3,4,5,6};
+        {
+            H5File h5_file(filename, 'w');
+            h5_write_matrix(h5_file.id(), "/factors", factors.data(), k_rows, k_cols);
+            h5_write_matrix(h5_file.id(), "/small", MatrixView<const int>(small.data(), 2, 3));
+        } {
+            H5File h5_file(filename, 'r');
+            auto dims = h5_query_dataset_dim(h5_file, "/factors");
+            REQUIRE(dims == std::vector<std::size_t>{k_rows, k_cols});
+
+            std::vector<double> factors_load(dims[0] * dims[1]);
+            MatrixView<double> view(factors_load.data(), dims[0], dims[1]);
+            h5_read_matrix(h5_file, "/factors", view);
+            REQUIRE(factors_load == factors);
+            REQUIRE(view(1, 2) == factors[1 * k_cols + 2]);
+
+            std::vector<int> small_load(6);
+            h5_read_matrix(h5_file.id(), "/small", MatrixView<int>(small_load.data(), 2, 3));
+            REQUIRE(small_load == small);
+            REQUIRE_THROWS(h5_read_matrix(h5_file, "/small", MatrixView<int>(small_load.data(), 3, 2)));
+            REQUIRE_THROWS(h5_read_matrix(h5_file, "/small", MatrixView<int, 1>(small_load.data(), 6)));
+
+            // read as a flat vector as well
+            std::vector<double> flat_load;
+            h5_read_vector(h5_file, "/factors", flat_load);
+            REQUIRE(flat_load == factors);
+        }
+        unlink(filename.c_str());
+    }
 }
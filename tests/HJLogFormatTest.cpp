@@ -10,9 +10,12 @@
 
 #include "LogConfig.h"
 #define FUN_EVT_FORMAT_STR "[{:16.16s}] [{:12.12s}] " // unittests are written based on this format
+#define WCC_LOG_ACTIVE_LEVEL 1  // trace is compiled out
 #include "HJLogFormat.h"
 
 #include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <chrono>
 
 // Struct with an attached logger named "Test"
 struct Logged : wcc::AttachLogger<"Test"> {
@@ -42,7 +45,7 @@ TEST_CASE("Logger", "[LogConfig]") {
    // Note no timestamp here so that we can compare log content
    YAML::Node cfg = YAML::Load(R"(
        default_format : "[%-8l] [%-12n] %v"
-       default_level : "error"
+       default_level : "info"
        default_log_dir : "log"
        default_log_prefix: "test"
        sinks:
@@ -111,4 +114,44 @@ TEST_CASE("Logger", "[LogConfig]") {
             "[info    ] [Test        ] [run             ] [with_id     ] [-] {x:1,msg:hello,pi:3.14}\n"
        );
    }
+
+   SECTION("Level filtering") {
+       int calls = 0;
+       auto count = [&calls] { return ++calls; };
+       LOG(debug, "event", (count()));  // below the logger level: arguments are not evaluated
+       REQUIRE(calls == 0);
+       LOG(info, "event", (count()));
+       REQUIRE(calls == 1);
+
+       struct NotFormattable {};
+       LOG(trace, "event", (NotFormattable{}));  // below WCC_LOG_ACTIVE_LEVEL: not even compiled
+       wcc::get_logger_str();
+   }
+
+   SECTION("Limited variants") {
+       using namespace std::chrono_literals;
+       wcc::get_logger_str();
+       for (int i = 0; i < 10; ++i) LOG_EVERY_N(4, info, "every", VAR(i));
+       REQUIRE(wcc::get_logger_str() ==
+            "[info    ] [main        ] [CATCH2_INTERNAL_] [every       ] {i:0,suppressed:0}\n"
+            "[info    ] [main        ] [CATCH2_INTERNAL_] [every       ] {i:4,suppressed:3}\n"
+            "[info    ] [main        ] [CATCH2_INTERNAL_] [every       ] {i:8,suppressed:3}\n"
+       );
+
+       for (int i = 0; i < 1000; ++i) LOG_RATE(5, info, "rate", VAR(i));  // burst of 5, then nearly nothing
+       auto str = wcc::get_logger_str();
+       auto lines = std::count(str.begin(), str.end(), '\n');
+       REQUIRE(lines >= 5);
+       REQUIRE(lines <= 6);
+
+       int calls = 0;
+       auto next = [&calls] { return ++calls / 3; };  // 0 0 1 1 1 2 ...
+       for (int i = 0; i < 6; ++i) LOG_DEDUP(1h, info, "dedup", ("v:{}", next()));
+       REQUIRE(calls == 6);  // evaluated once per call
+       REQUIRE(wcc::get_logger_str() ==
+            "[info    ] [main        ] [CATCH2_INTERNAL_] [dedup       ] {v:0,suppressed:0}\n"
+            "[info    ] [main        ] [CATCH2_INTERNAL_] [dedup       ] {v:1,suppressed:1}\n"
+            "[info    ] [main        ] [CATCH2_INTERNAL_] [dedup       ] {v:2,suppressed:2}\n"
+       );
+   }
 }
\ No newline at end of file
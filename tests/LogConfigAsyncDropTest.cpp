@@ -0,0 +1,47 @@
+/*
+* LogConfigAsyncDropTest.cpp
+*
+* This file contains tests for log_flush in async mode with async_overflow drop_oldest,
+* where the flush barriers themselves may be discarded from a full queue.
+*/
+
+#include "LogConfig.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <thread>
+
+TEST_CASE("AsyncLoggerDropOldest", "[LogConfig]") {
+   YAML::Node cfg = YAML::Load(R"(
+       default_format : "%v"
+       default_level : "info"
+       default_log_dir : "log"
+       default_log_prefix: "test"
+       async: true
+       async_queue_size: 16
+       async_overflow: drop_oldest
+       async_threads: 2
+       sinks:
+       - string
+       loggers:
+       - main
+       set_error_loggers:
+       set_debug_loggers:
+   )");
+
+   wcc::config_log(cfg);
+
+   SECTION("Flush under a flooded queue") {
+       std::atomic<bool> stop{false};
+       std::jthread flood([&stop] {
+           while (!stop.load()) wcc::log_info("flood");
+       });
+       for (int i = 0; i < 50; ++i) wcc::log_flush();  // returns although barriers get dropped
+       stop.store(true);
+       flood.join();
+
+       wcc::log_info("done");
+       wcc::log_flush_all();
+       REQUIRE(wcc::get_logger_str().ends_with("done\n"));
+   }
+}
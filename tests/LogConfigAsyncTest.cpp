@@ -0,0 +1,66 @@
+/*
+* LogConfigAsyncTest.cpp
+*
+* This file contains tests for the async mode of LogConfig, where sinks are
+* written by a dedicated thread pool. log_flush waits for the pool.
+*/
+
+#include "LogConfig.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+TEST_CASE("AsyncLogger", "[LogConfig]") {
+   YAML::Node cfg = YAML::Load(R"(
+       default_format : "[%-8l] [%-12n] %v"
+       default_level : "info"
+       default_log_dir : "log"
+       default_log_prefix: "test"
+       async: true
+       async_queue_size: 1024
+       async_overflow: block
+       async_threads: 2
+       async_cpu_affinity: [0]
+       sinks:
+       - string
+       loggers:
+       - main
+       - Test
+       set_error_loggers:
+       - Test
+       set_debug_loggers:
+   )");
+
+   wcc::config_log(cfg);
+
+   SECTION("Async loggers") {
+       REQUIRE(dynamic_cast<spdlog::async_logger*>(wcc::get_logger("main")) != nullptr);
+       REQUIRE(wcc::get_logger("Test")->level() == spdlog::level::err);  // level lists are applied
+   }
+
+   SECTION("Flush waits for the pool") {
+       wcc::log_debug("This is a {} message", "debug");
+       wcc::log_info("pi = {:.4f}", 3.1415926);
+       wcc::log_flush();
+       REQUIRE(wcc::get_logger_str() == "[info    ] [main        ] pi = 3.1416\n");
+
+       constexpr int N = 5000;  // more than the queue holds
+       for (int i = 0; i < N; ++i) wcc::log_info("{}", i);
+       wcc::log_flush_all();
+       auto str = wcc::get_logger_str();
+       REQUIRE(std::count(str.begin(), str.end(), '\n') == N);
+   }
+
+   SECTION("Benchmark") {
+       BENCHMARK("async log") {
+           wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+           wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+           wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+       };
+       wcc::log_flush();
+       wcc::get_logger_str();
+   }
+}
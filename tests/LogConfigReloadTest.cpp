@@ -0,0 +1,130 @@
+/*
+* LogConfigReloadTest.cpp
+*
+* This file contains tests for changing logger levels at runtime: the reload API,
+* the config file watcher and the commands of the control fifo.
+*/
+
+#include "LogConfig.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+static void write_config(std::string const& path, std::string const& debug_loggers) {
+    std::ofstream out(path + ".tmp");
+    out << R"(
+default_format : "[%-8l] [%-12n] %v"
+default_level : "info"
+default_log_dir : "log"
+default_log_prefix: "test"
+sinks:
+- string
+loggers:
+- main
+- Test
+set_error_loggers:
+set_debug_loggers: )" << debug_loggers << R"(
+watch_config: true
+control_fifo: "LogConfigReloadTest.dir/ctl.fifo"
+)";
+    out.close();
+    fs::rename(path + ".tmp", path);  // the way most editors save
+}
+
+// Wait for the watcher thread to apply a change
+template <typename Pred>
+static bool eventually(Pred pred) {
+    for (int i = 0; i < 300 && !pred(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return pred();
+}
+
+TEST_CASE("LogConfigReload", "[LogConfig]") {
+    fs::path dir = "LogConfigReloadTest.dir";
+    fs::create_directories(dir);
+    std::string path = (dir / "log.yaml").string();
+    write_config(path, "");
+    wcc::config_log(path);
+    auto* test = wcc::get_logger("Test");
+    auto* main = wcc::get_logger("main");
+
+    SECTION("Reload API") {
+        REQUIRE_FALSE(test->should_log(spdlog::level::debug));
+        auto cfg = YAML::LoadFile(path);
+        cfg["set_debug_loggers"].push_back("Test");
+        wcc::reload_log_levels(cfg);
+        REQUIRE(test->should_log(spdlog::level::debug));
+        REQUIRE_FALSE(main->should_log(spdlog::level::debug));
+
+        cfg["set_error_loggers"].push_back("Missing");  // rejected as a whole
+        cfg["set_debug_loggers"] = YAML::Node(YAML::NodeType::Null);
+        REQUIRE_THROWS_AS(wcc::reload_log_levels(cfg), std::runtime_error);
+        REQUIRE(test->should_log(spdlog::level::debug));
+
+        wcc::reload_log_levels();
+        REQUIRE_FALSE(test->should_log(spdlog::level::debug));
+
+        wcc::set_log_level("main", "warning");
+        REQUIRE_FALSE(main->should_log(spdlog::level::info));
+        REQUIRE_THROWS_AS(wcc::set_log_level("main", "loud"), std::runtime_error);
+        wcc::set_log_level("main", "info");
+    }
+
+    SECTION("Config file watcher") {
+        write_config(path, "[Test]");
+        REQUIRE(eventually([&] { return test->should_log(spdlog::level::debug); }));
+        wcc::log_debug("not shown");
+        wcc::get_logger<"Test">()->debug("shown");
+        REQUIRE(wcc::get_logger_str() == "[debug   ] [Test        ] shown\n");
+
+        write_config(path, "");
+        REQUIRE(eventually([&] { return !test->should_log(spdlog::level::debug); }));
+    }
+
+    SECTION("Control fifo") {
+        auto send = [&](std::string const& command) {
+            std::ofstream fifo(dir / "ctl.fifo");
+            fifo << command << '\n';
+        };
+        send("level * debug");
+        REQUIRE(eventually([&] { return main->should_log(spdlog::level::debug); }));
+        REQUIRE(test->should_log(spdlog::level::debug));
+
+        send("reload");
+        REQUIRE(eventually([&] { return !main->should_log(spdlog::level::debug); }));
+
+        send("bogus command");  // reported on stderr, nothing changes
+        send("level Test trace 300ms");
+        REQUIRE(eventually([&] { return test->should_log(spdlog::level::trace); }));
+        REQUIRE_FALSE(main->should_log(spdlog::level::debug));
+        REQUIRE(eventually([&] { return !test->should_log(spdlog::level::debug); }));  // restored to info
+        REQUIRE(test->level() == spdlog::level::info);
+    }
+
+    SECTION("Overlapping timed levels") {
+        auto send = [&](std::string const& command) {
+            std::ofstream fifo(dir / "ctl.fifo");
+            fifo << command << '\n';
+        };
+        send("level Test trace 300ms");
+        REQUIRE(eventually([&] { return test->level() == spdlog::level::trace; }));
+        send("level Test debug 300ms");  // keeps the original info to restore, and the later deadline
+        REQUIRE(eventually([&] { return test->level() == spdlog::level::debug; }));
+        REQUIRE(eventually([&] { return test->level() == spdlog::level::info; }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        REQUIRE(test->level() == spdlog::level::info);
+
+        // a reload during the window wins over the pending restore
+        send("level main debug 200ms");
+        REQUIRE(eventually([&] { return main->level() == spdlog::level::debug; }));
+        write_config(path, "[main]");
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        REQUIRE(main->level() == spdlog::level::debug);
+        write_config(path, "");
+        REQUIRE(eventually([&] { return main->level() == spdlog::level::info; }));
+    }
+}
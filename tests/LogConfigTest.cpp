@@ -16,13 +16,17 @@ TEST_CASE("Logger", "[LogConfig]") {
    // Note no timestamp here so that we can compare log content
    YAML::Node cfg = YAML::Load(R"(
        default_format : "[%-8l] [%-12n] %v"
-       default_level : "error"
+       default_level : "info"
        default_log_dir : "log"
        default_log_prefix: "test"
        sinks:
        - stdout
        - string
        - basic_file
+       - rotating_file
+       max_file_size: 1048576
+       max_files: 3
+       compression: none
        loggers:
        - main
        - Test
@@ -57,6 +61,13 @@ TEST_CASE("Logger", "[LogConfig]") {
        );
    }
 
+   SECTION("Logger handles") {
+       REQUIRE(wcc::get_logger<"main">() == wcc::get_logger("main"));
+       REQUIRE(wcc::get_logger("main")->level() == spdlog::level::info);  // default_level applied to stored loggers
+       REQUIRE(wcc::log_enabled(spdlog::level::info));
+       REQUIRE_FALSE(wcc::log_enabled(spdlog::level::debug));
+   }
+
     SECTION("Benchmark") {
         auto p_logger = wcc::get_logger("main");
         BENCHMARK("simple log") {
@@ -64,6 +75,11 @@ TEST_CASE("Logger", "[LogConfig]") {
             p_logger->info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
             p_logger->info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
         };
+        BENCHMARK("free log_info") {
+            wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+            wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+            wcc::log_info("This is a {} message, {}, {}, {}", "debug", 3.14, 314, 314ul);
+        };
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+/*
+* LogFileSinksTest.cpp
+*
+* This file contains tests for the size-capped/daily file sinks and the
+* background compression of closed segments.
+*/
+
+#include "LogFileSinks.h"
+#include <spdlog/logger.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static std::string read_file(std::string const& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream oss;
+    oss << in.rdbuf();
+    return oss.str();
+}
+
+TEST_CASE("SegmentFileSink", "[LogConfig]") {
+    fs::path dir = "LogFileSinksTest.dir";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string base = (dir / "test").string();
+
+    SECTION("Size rotation keeps max_files closed segments") {
+        {
+            auto sink = std::make_shared<wcc::sinks::segment_file_sink_mt>(base, 100, false, 2);
+            spdlog::logger logger("test", sink);
+            logger.set_pattern("%v");
+            for (int i = 0; i < 10; ++i) logger.info("{:039d}", i);  // 40 bytes per line, 2 lines per segment
+        }
+        // segments 0..4, of which 0 and 1 were removed
+        REQUIRE_FALSE(fs::exists(base + ".0.log"));
+        REQUIRE_FALSE(fs::exists(base + ".1.log"));
+        REQUIRE(read_file(base + ".2.log") == fmt::format("{:039d}\n{:039d}\n", 4, 5));
+        REQUIRE(read_file(base + ".4.log") == fmt::format("{:039d}\n{:039d}\n", 8, 9));
+    }
+
+    SECTION("Daily segment name") {
+        auto sink = std::make_shared<wcc::sinks::segment_file_sink_mt>(base, 0, true, 0);
+        auto t = std::time(nullptr);
+        char date[9];
+        std::strftime(date, sizeof(date), "%Y%m%d", std::localtime(&t));
+        REQUIRE(sink->filename() == fmt::format("{}.{}.log", base, date));
+    }
+
+#ifdef WCC_LOG_GZIP
+    SECTION("Closed segments are compressed in the background") {
+        auto compressor = std::make_shared<wcc::SegmentCompressor>(wcc::LogCompression::gzip);
+        {
+            auto sink = std::make_shared<wcc::sinks::segment_file_sink_mt>(base, 100, false, 0, compressor);
+            spdlog::logger logger("test", sink);
+            logger.set_pattern("%v");
+            for (int i = 0; i < 4; ++i) logger.info("{:039d}", i);
+        }
+        compressor->wait_idle();
+        REQUIRE_FALSE(fs::exists(base + ".0.log"));
+        REQUIRE(fs::exists(base + ".1.log"));  // the open segment is left as is
+
+        gzFile in = gzopen((base + ".0.log.gz").c_str(), "rb");
+        REQUIRE(in != nullptr);
+        char buf[256];
+        int n = gzread(in, buf, sizeof(buf));
+        gzclose(in);
+        REQUIRE(std::string(buf, n) == fmt::format("{:039d}\n{:039d}\n", 0, 1));
+    }
+
+    SECTION("Pruning does not race the compression") {
+        auto compressor = std::make_shared<wcc::SegmentCompressor>(wcc::LogCompression::gzip);
+        {
+            auto sink = std::make_shared<wcc::sinks::segment_file_sink_mt>(base, 100, false, 2, compressor);
+            spdlog::logger logger("test", sink);
+            logger.set_pattern("%v");
+            for (int i = 0; i < 200; ++i) logger.info("{:039d}", i);  // segments 0..99, pruned while queued
+        }
+        compressor->wait_idle();
+        size_t n_files = 0;
+        for (auto const& entry : fs::directory_iterator(dir)) {
+            auto name = entry.path().filename().string();
+            REQUIRE((name == "test.97.log.gz" || name == "test.98.log.gz" || name == "test.99.log"));
+            ++n_files;
+        }
+        REQUIRE(n_files == 3);
+    }
+#endif
+
+    REQUIRE_THROWS_AS(wcc::log_compression_from_str("lz4"), std::runtime_error);
+    fs::remove_all(dir);
+}
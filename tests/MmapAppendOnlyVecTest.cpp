@@ -0,0 +1,109 @@
+#include <catch2/catch_test_macros.hpp>
+#include "MmapAppendOnlyVec.h"
+#include <vector>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Tick {
+    int64_t time;
+    double  price;
+};
+
+TEST_CASE("MmapAppendOnlyVec", "[MmapAppendOnlyVec]") {
+    constexpr size_t CHUNK_SIZE = 1024;
+    using Vec = wcc::MmapAppendOnlyVec<Tick, CHUNK_SIZE>;
+    std::string filename = "MmapAppendOnlyVecTest.bin";
+    unlink(filename.c_str());
+
+    SECTION("Write, reopen and append") {
+        {
+            Vec vec(filename, 'w');
+            REQUIRE(vec.size() == 0);
+            for (int i = 0; i < 3000; ++i) vec.push_back(Tick{i, i * 0.5});
+            REQUIRE(vec.size() == 3000);
+            REQUIRE(vec.capacity() == 3 * CHUNK_SIZE);
+            REQUIRE(vec[2999].time == 2999);
+            vec.sync();
+        }
+        {
+            Vec vec(filename, 'a');  // recovered without parsing
+            REQUIRE(vec.size() == 3000);
+            REQUIRE(vec[1234].price == 617.0);
+
+            std::vector<Tick> block(2000);
+            for (int i = 0; i < 2000; ++i) block[i] = Tick{3000 + i, 0};
+            vec.append(block);
+            REQUIRE(vec.size() == 5000);
+            REQUIRE(vec.back().time == 4999);
+        }
+        {
+            Vec vec(filename, 'r');
+            REQUIRE(vec.size() == 5000);
+            int64_t expected = 0;
+            bool ok = true;
+            for (Tick const& t : vec) ok = ok && t.time == expected++;
+            REQUIRE(ok);
+            REQUIRE_THROWS_AS(vec.push_back(Tick{}), std::logic_error);
+        }
+        {
+            Vec vec(filename, 'w');  // truncated
+            REQUIRE(vec.size() == 0);
+        }
+    }
+
+    SECTION("Reader follows writer") {
+        Vec writer(filename, 'w');
+        writer.push_back(Tick{0, 0});
+        Vec reader(filename, 'r');
+        REQUIRE(reader.size() == 1);
+        for (size_t i = 1; i < 10 * CHUNK_SIZE; ++i) writer.push_back(Tick{int64_t(i), 0});
+        REQUIRE(reader.size() == 10 * CHUNK_SIZE);  // maps the grown file
+        REQUIRE(reader[10 * CHUNK_SIZE - 1].time == 10 * CHUNK_SIZE - 1);
+    }
+
+    SECTION("Single writer and layout check") {
+        {
+            Vec writer(filename, 'w');
+            REQUIRE_THROWS_AS(Vec(filename, 'a'), std::runtime_error);
+            writer.push_back(Tick{1, 1});
+        }
+        REQUIRE_THROWS_AS((wcc::MmapAppendOnlyVec<double, CHUNK_SIZE>(filename, 'r')), std::runtime_error);
+        REQUIRE_THROWS_AS((wcc::MmapAppendOnlyVec<Tick, 2 * CHUNK_SIZE>(filename, 'a')), std::runtime_error);
+        REQUIRE_THROWS_AS(Vec(filename, 'x'), std::invalid_argument);
+        REQUIRE_THROWS_AS(Vec("no_such_file.bin", 'r'), std::runtime_error);
+    }
+
+    SECTION("Shared memory across processes") {
+        using ShmVec = wcc::ShmAppendOnlyVec<Tick, CHUNK_SIZE>;
+        std::string name = "/MmapAppendOnlyVecTest." + std::to_string(getpid());
+        constexpr int64_t N = 20 * CHUNK_SIZE;
+
+        ShmVec writer(name, 'w');
+        writer.push_back(Tick{0, 0});
+        pid_t pid = fork();
+        if (pid == 0) {  // reader process, following the writer
+            int rc = 0;
+            try {
+                ShmVec reader(name, 'r');
+                for (int64_t next = 0; next < N; ) {
+                    for (int64_t n = reader.size(); next < n; ++next) {
+                        if (reader[next].time != next) rc = 1;
+                    }
+                }
+            } catch (...) {
+                rc = 2;
+            }
+            _exit(rc);
+        }
+        for (int64_t i = 1; i < N; ++i) writer.push_back(Tick{i, 0});
+        int status = -1;
+        waitpid(pid, &status, 0);
+        ShmVec::remove(name);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+        REQUIRE_THROWS_AS(ShmVec(name, 'r'), std::runtime_error);  // removed
+    }
+
+    unlink(filename.c_str());
+}
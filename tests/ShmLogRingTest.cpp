@@ -0,0 +1,101 @@
+/*
+* ShmLogRingTest.cpp
+*
+* This file contains tests for the shared-memory log ring: the writer/reader pair,
+* the spdlog sink and the merge done by the collector.
+*/
+
+#include "ShmLogRing.h"
+#include <spdlog/logger.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+TEST_CASE("ShmLogRing", "[LogConfig]") {
+    fs::path dir = "ShmLogRingTest.dir";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    auto ring_path = [&](int n) { return (dir / fmt::format("test.pid.{}.ring", n)).string(); };
+
+    SECTION("Messages spanning records") {
+        wcc::ShmLogRingWriter writer(ring_path(1), 64);
+        wcc::ShmLogRingReader reader(ring_path(1));
+        std::string long_text(600, 'x');
+        REQUIRE(writer.write(1, 2, "short\n"));
+        REQUIRE(writer.write(2, 3, long_text));
+        REQUIRE(writer.write(3, 2, ""));
+
+        std::string out;
+        REQUIRE(reader.front()->time_ns == 1);
+        reader.pop(out);
+        REQUIRE(out == "short\n");
+        out.clear();
+        REQUIRE(reader.front()->level == 3);
+        reader.pop(out);
+        REQUIRE(out == long_text);
+        reader.pop(out);
+        REQUIRE(out == long_text);
+        REQUIRE(reader.front() == nullptr);
+        REQUIRE(reader.empty());
+    }
+
+    SECTION("Full ring drops without waiting") {
+        wcc::ShmLogRingWriter writer(ring_path(1), 64);
+        int written = 0;
+        for (int i = 0; i < 100; ++i) written += writer.write(i, 2, "x");
+        REQUIRE(written == 64);
+        REQUIRE(writer.dropped() == 36);
+    }
+
+    SECTION("Sink") {
+        auto sink = std::make_shared<wcc::sinks::shm_ring_sink_mt>(ring_path(1), 1024);
+        spdlog::logger logger("test", sink);
+        logger.set_pattern("[%n] %v");
+        logger.info("hello {}", 1);
+        logger.debug("not shown");
+
+        wcc::ShmLogRingReader reader(ring_path(1));
+        std::string out;
+        reader.pop(out);
+        REQUIRE(out == "[test] hello 1\n");
+        REQUIRE(reader.front() == nullptr);
+    }
+
+    SECTION("Collector merges by time and removes finished rings") {
+        auto a = std::make_unique<wcc::ShmLogRingWriter>(ring_path(1), 64);
+        auto b = std::make_unique<wcc::ShmLogRingWriter>(ring_path(2), 64);
+        REQUIRE(a->write(10, 2, "a10\n"));
+        REQUIRE(b->write(20, 2, "b20\n"));
+        REQUIRE(a->write(30, 2, "a30\n"));
+        REQUIRE(b->write(40, 2, "b40\n"));
+        for (int i = 0; i < 70; ++i) b->write(50, 2, "b50\n");  // 62 fit, 8 dropped
+
+        wcc::ShmLogCollector collector(dir.string(), "test", std::chrono::seconds(1));
+        collector.scan();
+        REQUIRE(collector.rings() == 2);
+        std::string out;
+        std::string dropped = fmt::format("ShmLogCollector,Dropped,pid={},count=8\n", getpid());
+        REQUIRE(collector.collect(out, dropped.size() + 12) == 3);  // stops at max_bytes
+        REQUIRE(out == dropped + "a10\nb20\na30\n");
+
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        REQUIRE(a->write(now, 2, "recent\n"));
+        out.clear();
+        REQUIRE(collector.collect(out, 1 << 20) == 63);  // "recent" is held for merge_delay
+        REQUIRE(out.starts_with("b40\nb50\n"));
+        out.clear();
+        REQUIRE(collector.collect(out, 1 << 20, true) == 1);
+        REQUIRE(out == "recent\n");
+
+        a.reset();  // closed and drained
+        collector.scan();
+        REQUIRE(collector.rings() == 1);
+        REQUIRE_FALSE(fs::exists(ring_path(1)));
+        REQUIRE(fs::exists(ring_path(2)));
+    }
+
+    fs::remove_all(dir);
+}
@@ -0,0 +1,84 @@
+/*
+* TscClockTest.cpp
+*
+* This file contains tests for the TSC timestamp source and its use by the
+* deferred backend of LogConfig ("clock: tsc").
+*/
+
+#include "LogConfig.h"
+#include "TscClock.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <chrono>
+#include <cstdlib>
+
+static int64_t realtime_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+TEST_CASE("TscClock", "[LogConfig]") {
+    wcc::TscClock clock;
+    REQUIRE(clock.ns_per_tick() > 0);
+
+    SECTION("Conversion follows CLOCK_REALTIME") {
+        for (int i = 0; i < 3; ++i) {
+            int64_t before = realtime_ns();
+            int64_t ns = clock.to_ns(wcc::TscClock::now());
+            int64_t after = realtime_ns();
+            REQUIRE(ns > before - 1'000'000);  // 1ms slack for the calibration error
+            REQUIRE(ns < after + 1'000'000);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            clock.recalibrate();
+        }
+    }
+
+    SECTION("Monotonic within a thread") {
+        uint64_t prev = wcc::TscClock::now();
+        for (int i = 0; i < 1000; ++i) {
+            uint64_t t = wcc::TscClock::now();
+            REQUIRE(t >= prev);
+            prev = t;
+        }
+    }
+
+    SECTION("Deferred backend") {
+        YAML::Node cfg = YAML::Load(R"(
+            default_format : "%E|%v"
+            default_level : "info"
+            default_log_dir : "log"
+            default_log_prefix: "test"
+            backend: deferred
+            clock: tsc
+            tsc_recalibrate_ms: 10
+            sinks:
+            - string
+            loggers:
+            - main
+            set_error_loggers:
+            set_debug_loggers:
+        )");
+        wcc::config_log(cfg);
+
+        auto before = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        wcc::log_info("first");
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));  // a recalibration in between
+        wcc::log_info("second");
+        wcc::log_flush();
+        auto after = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+        auto str = wcc::get_logger_str();
+        auto second = str.find('\n') + 1;
+        REQUIRE(str.substr(str.find('|'), 7) == "|first\n");
+        REQUIRE(str.substr(str.find('|', second)) == "|second\n");
+        for (auto pos : {size_t{0}, second}) {
+            auto t = std::strtoll(str.c_str() + pos, nullptr, 10);
+            REQUIRE(t >= before);
+            REQUIRE(t <= after);
+        }
+
+        BENCHMARK("TscClock::now") { return wcc::TscClock::now(); };
+        BENCHMARK("system_clock::now") { return std::chrono::system_clock::now(); };
+    }
+}